@@ -18,15 +18,38 @@
 #ifndef DISTRHO_PLUGIN_INFO_H_INCLUDED
 #define DISTRHO_PLUGIN_INFO_H_INCLUDED
 
+#include "OpalMacros.h"
+
+// the Makefile builds one plugin per channel count
+#ifndef OPAL_NUM_CHANNELS
+#define OPAL_NUM_CHANNELS 1
+#endif
+
+#define OPAL_NAME(n)        "OpalChorus" OPAL_STRINGIFY(n)
+
 #define DISTRHO_PLUGIN_BRAND "StudioGems"
+#if OPAL_NUM_CHANNELS==1
 #define DISTRHO_PLUGIN_NAME  "OpalChorus"
+#elif OPAL_NUM_CHANNELS==2
+#define DISTRHO_PLUGIN_NAME  "OpalChorusStereo"
+#else
+#define DISTRHO_PLUGIN_NAME  OPAL_NAME(OPAL_NUM_CHANNELS)
+#endif
 #define DISTRHO_PLUGIN_URI   "https://"
 
 #define DISTRHO_PLUGIN_HAS_UI        1
 #define DISTRHO_PLUGIN_IS_RT_SAFE    1
-#define DISTRHO_PLUGIN_NUM_INPUTS    1
-#define DISTRHO_PLUGIN_NUM_OUTPUTS   1
+#define DISTRHO_PLUGIN_WANT_LATENCY  1
+#define DISTRHO_PLUGIN_NUM_INPUTS    OPAL_NUM_CHANNELS
+#define DISTRHO_PLUGIN_NUM_OUTPUTS   OPAL_NUM_CHANNELS
 #define DISTRHO_UI_FILE_BROWSER      0
 #define DISTRHO_UI_USER_RESIZABLE    0
+#define DISTRHO_UI_USE_CAIRO         1
+
+// for formats with the UI in the host process, e.g. LV2 or VST; a DSSI UI
+// gets the telemetry through the output parameters instead
+#ifdef OPAL_DIRECT_ACCESS
+#define DISTRHO_PLUGIN_WANT_DIRECT_ACCESS 1
+#endif
 
 #endif // DISTRHO_PLUGIN_INFO_H_INCLUDED
@@ -0,0 +1,256 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <new>
+#include "OpalAPI.h"
+#include "OpalKernels.h"
+
+using namespace StudioGemsDSP;
+
+// the chorus and the parameters as set, pushed into it before every block
+struct opal_chorus {
+    static constexpr int CHUNK=Modulation::BLOCK_SIZE;
+
+    Chorus  chorus;
+    int     channels;
+
+    float   params[OPAL_NUM_PARAMS]={ 1.0f, 10.0f, 1.0f, INTERP_LINEAR, 0.5f, 1.0f };
+
+    float   scratch[MAX_CHANNELS][CHUNK];
+
+    opal_chorus(double samplerate, uint32_t seed, int channels, storage_t storage):
+        chorus(samplerate, seed, channels, storage),
+        channels(channels)
+    {
+    }
+
+    // all but the oversampling, which waits for opal_reset
+    void update()
+    {
+        chorus.set_numvoices((int) params[OPAL_PARAM_NUMVOICES]);
+        chorus.set_depth(params[OPAL_PARAM_DEPTH]);
+        chorus.set_frequency(params[OPAL_PARAM_FREQUENCY]);
+        chorus.set_interpolation((interpolation_t) params[OPAL_PARAM_INTERPOLATION]);
+        chorus.set_width(params[OPAL_PARAM_WIDTH]);
+    }
+};
+
+
+// the batch and its parameters, which are passed on right away
+struct opal_batch {
+    ChorusBatch batch;
+
+    float       (*params)[OPAL_NUM_PARAMS];
+
+    opal_batch(double samplerate, int instances, const uint32_t* seeds, storage_t storage):
+        batch(samplerate, instances, seeds, storage),
+        params(new float[instances][OPAL_NUM_PARAMS])
+    {
+        for (int k=0;k<instances;k++) {
+            const float defaults[OPAL_NUM_PARAMS]={ 1.0f, 10.0f, 1.0f, INTERP_LINEAR, 0.5f, 1.0f };
+
+            for (int p=0;p<OPAL_NUM_PARAMS;p++)
+                set(k, (opal_param_t) p, defaults[p]);
+        }
+    }
+
+    ~opal_batch()
+    {
+        delete[] params;
+    }
+
+    void set(int instance, opal_param_t param, float value)
+    {
+        switch (param) {
+        case OPAL_PARAM_NUMVOICES:
+            batch.set_numvoices(instance, (int) value);
+            break;
+        case OPAL_PARAM_DEPTH:
+            batch.set_depth(instance, value);
+            break;
+        case OPAL_PARAM_FREQUENCY:
+            batch.set_frequency(instance, value);
+            break;
+        case OPAL_PARAM_INTERPOLATION:
+            batch.set_interpolation((interpolation_t) value);
+
+            for (int k=0;k<batch.get_instances();k++)
+                params[k][param]=value;
+            return;
+        default:
+            break;
+        }
+
+        params[instance][param]=value;
+    }
+};
+
+
+opal_chorus* opal_create(double samplerate, uint32_t seed, int channels)
+{
+    return opal_create_ex(samplerate, seed, channels, OPAL_STORAGE_FLOAT);
+}
+
+
+opal_chorus* opal_create_ex(double samplerate, uint32_t seed, int channels, opal_storage_t storage)
+{
+    if (channels<1 || channels>MAX_CHANNELS || !(samplerate>0.0))
+        return nullptr;
+
+    // the delay line and the oversampler allocate in turn, and their
+    // exceptions must not cross into C
+    try {
+        return new opal_chorus(samplerate, seed, channels, storage==OPAL_STORAGE_HALF ? STORAGE_HALF : STORAGE_FLOAT);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+
+void opal_destroy(opal_chorus* opal)
+{
+    delete opal;
+}
+
+
+void opal_set_parameter(opal_chorus* opal, opal_param_t param, float value)
+{
+    if (param>=0 && param<OPAL_NUM_PARAMS)
+        opal->params[param]=value;
+}
+
+
+float opal_get_parameter(const opal_chorus* opal, opal_param_t param)
+{
+    return param>=0 && param<OPAL_NUM_PARAMS ? opal->params[param] : 0.0f;
+}
+
+
+void opal_process(opal_chorus* opal, const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+    opal->update();
+    opal->chorus.process(inputs, outputs, frames);
+}
+
+
+void opal_process_interleaved(opal_chorus* opal, const float* input, float* output, uint32_t frames)
+{
+    const int channels=opal->channels;
+
+    const float* inputs[MAX_CHANNELS];
+    float* outputs[MAX_CHANNELS];
+
+    for (int c=0;c<channels;c++)
+        inputs[c]=outputs[c]=opal->scratch[c];
+
+    opal->update();
+
+    while (frames>0) {
+        const uint32_t n=frames<opal_chorus::CHUNK ? frames : opal_chorus::CHUNK;
+
+        for (uint32_t i=0;i<n;i++)
+            for (int c=0;c<channels;c++)
+                opal->scratch[c][i]=input[i*channels + c];
+
+        opal->chorus.process(inputs, outputs, n);
+
+        for (uint32_t i=0;i<n;i++)
+            for (int c=0;c<channels;c++)
+                output[i*channels + c]=opal->scratch[c][i];
+
+        input+=n*channels;
+        output+=n*channels;
+        frames-=n;
+    }
+}
+
+
+void opal_reset(opal_chorus* opal)
+{
+    opal->update();
+    opal->chorus.set_oversampling((int) opal->params[OPAL_PARAM_OVERSAMPLING]);
+    opal->chorus.seek(0);
+}
+
+
+int opal_latency(const opal_chorus* opal)
+{
+    return opal->chorus.latency();
+}
+
+
+void opal_seek(opal_chorus* opal, uint64_t frame)
+{
+    opal->update();
+    opal->chorus.seek(frame);
+}
+
+
+uint32_t opal_preroll(const opal_chorus* opal)
+{
+    return opal->chorus.preroll();
+}
+
+
+opal_batch* opal_batch_create(double samplerate, int instances, const uint32_t* seeds, opal_storage_t storage)
+{
+    if (instances<1 || !(samplerate>0.0))
+        return nullptr;
+
+    // as in opal_create_ex, which includes the groups and the parameters
+    try {
+        return new opal_batch(samplerate, instances, seeds, storage==OPAL_STORAGE_HALF ? STORAGE_HALF : STORAGE_FLOAT);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+
+void opal_batch_destroy(opal_batch* opal)
+{
+    delete opal;
+}
+
+
+void opal_batch_set_parameter(opal_batch* opal, int instance, opal_param_t param, float value)
+{
+    if (instance>=0 && instance<opal->batch.get_instances() && param>=0 && param<OPAL_NUM_PARAMS)
+        opal->set(instance, param, value);
+}
+
+
+float opal_batch_get_parameter(const opal_batch* opal, int instance, opal_param_t param)
+{
+    if (instance>=0 && instance<opal->batch.get_instances() && param>=0 && param<OPAL_NUM_PARAMS)
+        return opal->params[instance][param];
+
+    return 0.0f;
+}
+
+
+void opal_batch_process(opal_batch* opal, const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+    opal->batch.process(inputs, outputs, frames);
+}
+
+
+const char* opal_kernels(void)
+{
+    return select_kernels().name;
+}
@@ -0,0 +1,99 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#ifndef INCLUDE_STUDIOGEMS_OPALAPI_H
+#define INCLUDE_STUDIOGEMS_OPALAPI_H
+
+/* C interface to the Opal chorus, built by "make lib"; only the create and
+   destroy functions allocate */
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define OPAL_API __declspec(dllexport)
+#else
+#define OPAL_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct opal_chorus opal_chorus;
+typedef struct opal_batch opal_batch;
+
+/* the same parameters and ranges as the plugin */
+typedef enum {
+    OPAL_PARAM_NUMVOICES,       /* 1 to 128, default 1, above 8 the ensemble mode */
+    OPAL_PARAM_DEPTH,           /* modulation depth in ms, 0 to 100, default 10 */
+    OPAL_PARAM_FREQUENCY,       /* modulation frequency in Hz, 0.1 to 10, default 1 */
+    OPAL_PARAM_INTERPOLATION,   /* 0=linear, 1=hermite, 2=lagrange, 3=allpass, 4=sinc, default 0 */
+    OPAL_PARAM_WIDTH,           /* stereo width, 0 to 1, default 0.5, ignored for mono */
+    OPAL_PARAM_OVERSAMPLING,    /* 1, 2 or 4, default 1, takes effect on opal_reset */
+    OPAL_NUM_PARAMS
+} opal_param_t;
+
+/* sample format of the delay line, see storage_t in OpalDSP.h */
+typedef enum {
+    OPAL_STORAGE_FLOAT,
+    OPAL_STORAGE_HALF
+} opal_storage_t;
+
+/* returns NULL if channels is not within 1 to 8 or memory is short */
+OPAL_API opal_chorus* opal_create(double samplerate, uint32_t seed, int channels);
+OPAL_API opal_chorus* opal_create_ex(double samplerate, uint32_t seed, int channels, opal_storage_t storage);
+OPAL_API void opal_destroy(opal_chorus*);
+
+OPAL_API void opal_set_parameter(opal_chorus*, opal_param_t, float value);
+OPAL_API float opal_get_parameter(const opal_chorus*, opal_param_t);
+
+/* one buffer per channel; inputs and outputs may be the same buffers */
+OPAL_API void opal_process(opal_chorus*, const float* const* inputs, float* const* outputs, uint32_t frames);
+
+/* frames of channels samples each; input and output may be the same buffer */
+OPAL_API void opal_process_interleaved(opal_chorus*, const float* input, float* output, uint32_t frames);
+
+/* back to the start with silence before it, applying the oversampling as set */
+OPAL_API void opal_reset(opal_chorus*);
+
+/* delay of the output in frames, which depends on the oversampling */
+OPAL_API int opal_latency(const opal_chorus*);
+
+/* for rendering in parallel chunks: after a seek and opal_preroll frames of
+   input, the output matches that of one instance over the whole input */
+OPAL_API void opal_seek(opal_chorus*, uint64_t frame);
+OPAL_API uint32_t opal_preroll(const opal_chorus*);
+
+/* many mono choruses processed eight at a time, with at most 8 voices and
+   one interpolation for all; seeds may be NULL */
+OPAL_API opal_batch* opal_batch_create(double samplerate, int instances, const uint32_t* seeds, opal_storage_t storage);
+OPAL_API void opal_batch_destroy(opal_batch*);
+
+OPAL_API void opal_batch_set_parameter(opal_batch*, int instance, opal_param_t, float value);
+OPAL_API float opal_batch_get_parameter(const opal_batch*, int instance, opal_param_t);
+
+/* one buffer per instance; inputs and outputs may be the same buffers */
+OPAL_API void opal_batch_process(opal_batch*, const float* const* inputs, float* const* outputs, uint32_t frames);
+
+/* name of the kernel variant in use, i.e. baseline, avx2 or avx512 */
+OPAL_API const char* opal_kernels(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
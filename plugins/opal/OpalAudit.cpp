@@ -0,0 +1,801 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// real-time safety audit of PluginEngine::run, "make audit": fails with a
+// backtrace on any allocation, lock or blocking call in the callback (glibc)
+
+#include <cmath>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <vector>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+#include "OpalKernels.h"
+#include "OpalEngine.h"
+
+using namespace StudioGemsDSP;
+
+// the allocator of glibc, which the replacements below pass on to
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void  __libc_free(void*);
+}
+
+namespace {
+
+// set on a thread while it is in the audited callback, and while it
+// reports a call, which may itself allocate and lock
+thread_local bool inside=false;
+thread_local bool reporting=false;
+
+// the configuration being audited, for the reports
+char context[256];
+
+long violations=0;
+
+// hashes of the call stacks reported so far
+constexpr int MAX_SITES=1024;
+uint64_t sites[MAX_SITES];
+int numsites=0;
+
+
+void violation(const char* call)
+{
+    if (!inside || reporting)
+        return;
+
+    reporting=true;
+    violations++;
+
+    void* frames[64];
+    const int n=backtrace(frames, 64);
+
+    uint64_t site=0;
+    for (int i=0;i<n;i++)
+        site=site*0x100000001b3 ^ (uintptr_t) frames[i];
+
+    if (numsites<MAX_SITES && std::find(sites, sites + numsites, site)==sites + numsites) {
+        sites[numsites++]=site;
+
+        fprintf(stderr, "\n%s in the callback, %s\n", call, context);
+        fflush(stderr);
+
+        // without the frames of violation and the wrapper
+        backtrace_symbols_fd(frames + 2, n - 2, STDERR_FILENO);
+    }
+
+    reporting=false;
+}
+
+
+// the wrapped function, looked up on first use
+template<typename F>
+F next(F& real, const char* name)
+{
+    if (!real) {
+        const bool was=reporting;
+
+        reporting=true;
+        real=(F) dlsym(RTLD_NEXT, name);
+        reporting=was;
+    }
+
+    return real;
+}
+
+}
+
+
+// allocation
+
+extern "C" void* malloc(size_t size) noexcept
+{
+    violation("malloc");
+    return __libc_malloc(size);
+}
+
+
+extern "C" void* calloc(size_t count, size_t size) noexcept
+{
+    violation("calloc");
+    return __libc_calloc(count, size);
+}
+
+
+extern "C" void* realloc(void* ptr, size_t size) noexcept
+{
+    violation("realloc");
+    return __libc_realloc(ptr, size);
+}
+
+
+extern "C" void* memalign(size_t alignment, size_t size) noexcept
+{
+    violation("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    violation("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept
+{
+    violation("posix_memalign");
+
+    *ptr=__libc_memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+}
+
+
+extern "C" void* valloc(size_t size) noexcept
+{
+    violation("valloc");
+    return __libc_memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+
+extern "C" void free(void* ptr) noexcept
+{
+    if (ptr)
+        violation("free");
+
+    __libc_free(ptr);
+}
+
+
+void* operator new(size_t size)
+{
+    violation("operator new");
+
+    void* ptr=__libc_malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+
+void* operator new[](size_t size)
+{
+    violation("operator new[]");
+
+    void* ptr=__libc_malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    violation("operator new");
+    return __libc_malloc(size ? size : 1);
+}
+
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    violation("operator new[]");
+    return __libc_malloc(size ? size : 1);
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+    if (ptr)
+        violation("operator delete");
+
+    __libc_free(ptr);
+}
+
+
+void operator delete[](void* ptr) noexcept
+{
+    if (ptr)
+        violation("operator delete[]");
+
+    __libc_free(ptr);
+}
+
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    operator delete(ptr);
+}
+
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    operator delete[](ptr);
+}
+
+
+// the sized forms, which C++14 calls where the size is known, so that
+// these are caught however the C++ library implements its own
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    operator delete[](ptr);
+}
+
+
+// locking; trylock never waits, so it is allowed
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+{
+    static int (*real)(pthread_mutex_t*);
+
+    violation("pthread_mutex_lock");
+    return next(real, "pthread_mutex_lock")(mutex);
+}
+
+
+extern "C" int pthread_rwlock_rdlock(pthread_rwlock_t* lock) noexcept
+{
+    static int (*real)(pthread_rwlock_t*);
+
+    violation("pthread_rwlock_rdlock");
+    return next(real, "pthread_rwlock_rdlock")(lock);
+}
+
+
+extern "C" int pthread_rwlock_wrlock(pthread_rwlock_t* lock) noexcept
+{
+    static int (*real)(pthread_rwlock_t*);
+
+    violation("pthread_rwlock_wrlock");
+    return next(real, "pthread_rwlock_wrlock")(lock);
+}
+
+
+extern "C" int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    static int (*real)(pthread_cond_t*, pthread_mutex_t*);
+
+    violation("pthread_cond_wait");
+    return next(real, "pthread_cond_wait")(cond, mutex);
+}
+
+
+extern "C" int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime)
+{
+    static int (*real)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*);
+
+    violation("pthread_cond_timedwait");
+    return next(real, "pthread_cond_timedwait")(cond, mutex, abstime);
+}
+
+
+extern "C" int sem_wait(sem_t* sem)
+{
+    static int (*real)(sem_t*);
+
+    violation("sem_wait");
+    return next(real, "sem_wait")(sem);
+}
+
+
+extern "C" int sem_timedwait(sem_t* sem, const struct timespec* abstime)
+{
+    static int (*real)(sem_t*, const struct timespec*);
+
+    violation("sem_timedwait");
+    return next(real, "sem_timedwait")(sem, abstime);
+}
+
+
+// system calls, which may block or at least take unbounded time
+
+extern "C" long syscall(long number, ...) noexcept
+{
+    static long (*real)(long, ...);
+
+    // as many arguments as any system call takes
+    va_list args;
+    va_start(args, number);
+
+    long a[6];
+    for (int i=0;i<6;i++)
+        a[i]=va_arg(args, long);
+
+    va_end(args);
+
+    violation(number==SYS_futex ? "futex" : "syscall");
+    return next(real, "syscall")(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+
+extern "C" ssize_t read(int fd, void* buffer, size_t count)
+{
+    static ssize_t (*real)(int, void*, size_t);
+
+    violation("read");
+    return next(real, "read")(fd, buffer, count);
+}
+
+
+extern "C" ssize_t write(int fd, const void* buffer, size_t count)
+{
+    static ssize_t (*real)(int, const void*, size_t);
+
+    violation("write");
+    return next(real, "write")(fd, buffer, count);
+}
+
+
+extern "C" int open(const char* path, int flags, ...)
+{
+    static int (*real)(const char*, int, ...);
+
+    va_list args;
+    va_start(args, flags);
+    const mode_t mode=(flags & O_CREAT) ? va_arg(args, mode_t) : 0;
+    va_end(args);
+
+    violation("open");
+    return next(real, "open")(path, flags, mode);
+}
+
+
+extern "C" int close(int fd)
+{
+    static int (*real)(int);
+
+    violation("close");
+    return next(real, "close")(fd);
+}
+
+
+extern "C" int nanosleep(const struct timespec* duration, struct timespec* remaining)
+{
+    static int (*real)(const struct timespec*, struct timespec*);
+
+    violation("nanosleep");
+    return next(real, "nanosleep")(duration, remaining);
+}
+
+
+extern "C" int clock_nanosleep(clockid_t clock, int flags, const struct timespec* duration, struct timespec* remaining)
+{
+    static int (*real)(clockid_t, int, const struct timespec*, struct timespec*);
+
+    violation("clock_nanosleep");
+    return next(real, "clock_nanosleep")(clock, flags, duration, remaining);
+}
+
+
+extern "C" int usleep(useconds_t usec)
+{
+    static int (*real)(useconds_t);
+
+    violation("usleep");
+    return next(real, "usleep")(usec);
+}
+
+
+extern "C" int sched_yield() noexcept
+{
+    static int (*real)();
+
+    violation("sched_yield");
+    return next(real, "sched_yield")();
+}
+
+
+extern "C" int poll(struct pollfd* fds, nfds_t count, int timeout)
+{
+    static int (*real)(struct pollfd*, nfds_t, int);
+
+    violation("poll");
+    return next(real, "poll")(fds, count, timeout);
+}
+
+
+extern "C" int select(int count, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout)
+{
+    static int (*real)(int, fd_set*, fd_set*, fd_set*, struct timeval*);
+
+    violation("select");
+    return next(real, "select")(count, readfds, writefds, exceptfds, timeout);
+}
+
+
+extern "C" void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset) noexcept
+{
+    static void* (*real)(void*, size_t, int, int, int, off_t);
+
+    violation("mmap");
+    return next(real, "mmap")(addr, length, prot, flags, fd, offset);
+}
+
+
+extern "C" int munmap(void* addr, size_t length) noexcept
+{
+    static int (*real)(void*, size_t);
+
+    violation("munmap");
+    return next(real, "munmap")(addr, length);
+}
+
+
+extern "C" int mprotect(void* addr, size_t length, int prot) noexcept
+{
+    static int (*real)(void*, size_t, int);
+
+    violation("mprotect");
+    return next(real, "mprotect")(addr, length, prot);
+}
+
+
+extern "C" int madvise(void* addr, size_t length, int advice) noexcept
+{
+    static int (*real)(void*, size_t, int);
+
+    violation("madvise");
+    return next(real, "madvise")(addr, length, advice);
+}
+
+
+namespace {
+
+struct Options {
+    std::vector<int>    blocks { 1, 7, 64, 256, 1000, 4096 };
+    std::vector<int>    channels { 1, 2 };
+
+    int     rate=48000;
+
+    // audio processed per change of the parameters
+    int     frames=4096;
+};
+
+
+// a stretch of noise or silence at fixed or per-block random parameters
+struct Scene {
+    PluginParams  params;
+    bool    random=false;
+    bool    silent=false;
+    int     length=1;
+};
+
+
+// every value of every parameter, then random ones, then silence
+std::vector<Scene> scenes()
+{
+    std::vector<Scene> scenes;
+
+    const auto add=[&](const PluginParams& params) {
+        Scene scene;
+        scene.params=params;
+        scenes.push_back(scene);
+    };
+
+    const PluginParams defaults;
+    add(defaults);
+
+    for (int numvoices: { 2, 8, 9, 32, MAX_ENSEMBLE, 1 }) {
+        PluginParams params=defaults;
+        params.numvoices=numvoices;
+        add(params);
+    }
+
+    for (int oversampling: { 1, 2, 4 }) {
+        for (int q=0;q<NUM_INTERPOLATIONS;q++) {
+            PluginParams params=defaults;
+            params.numvoices=12;
+            params.interpolation=q;
+            params.oversampling=oversampling;
+            add(params);
+        }
+    }
+
+    for (float depth: { 0.0f, MAX_DEPTH, 0.5f }) {
+        PluginParams params=defaults;
+        params.depth=depth;
+        add(params);
+    }
+
+    for (float frequency: { 0.0f, 20.0f, 0.01f, -1.0f }) {
+        PluginParams params=defaults;
+        params.frequency=frequency;
+        add(params);
+    }
+
+    for (float width: { 0.0f, 1.0f }) {
+        PluginParams params=defaults;
+        params.width=width;
+        add(params);
+    }
+
+    for (bool offline: { true, false }) {
+        PluginParams params=defaults;
+        params.numvoices=MAX_ENSEMBLE;
+        params.offline=offline;
+        add(params);
+    }
+
+    Scene random;
+    random.random=true;
+    random.length=16;
+    scenes.push_back(random);
+
+    // a second of silence is beyond the tail at any depth
+    for (int oversampling: { 1, 4 }) {
+        Scene silence;
+        silence.params=defaults;
+        silence.params.depth=MAX_DEPTH;
+        silence.params.oversampling=oversampling;
+        silence.silent=true;
+        silence.length=64;
+        scenes.push_back(silence);
+
+        Scene resume=silence;
+        resume.silent=false;
+        resume.length=1;
+        scenes.push_back(resume);
+    }
+
+    return scenes;
+}
+
+
+uint32_t xorshift(uint32_t& x)
+{
+    x^=x<<13;
+    x^=x>>17;
+    x^=x<<5;
+    return x;
+}
+
+
+void usage(const char* name)
+{
+    printf("Usage: %s [options]\n"
+           "\n"
+           "  -b, --blocks=LIST       block sizes in frames, 1 to 8192 (1,7,64,256,1000,4096)\n"
+           "  -c, --channels=LIST     channel counts, 1 to %d (1,2)\n"
+           "  -r, --rate=HZ           sample rate in Hz (48000)\n"
+           "  -n, --frames=N          frames per change of the parameters (4096)\n"
+           "\n"
+           "Exits with failure if the callback allocated, locked or blocked.\n",
+           name, MAX_CHANNELS);
+}
+
+
+std::vector<int> parse_list(const char* arg)
+{
+    std::vector<int> values;
+
+    for (const char* p=arg;*p;) {
+        char* end;
+        const long value=strtol(p, &end, 10);
+
+        if (end==p || value<=0) {
+            fprintf(stderr, "invalid list '%s'\n", arg);
+            exit(EXIT_FAILURE);
+        }
+
+        values.push_back((int) value);
+
+        p=*end==',' ? end + 1 : end;
+    }
+
+    return values;
+}
+
+
+Options parse_options(int argc, char** argv)
+{
+    static const option longopts[]={
+        { "blocks",     required_argument,  nullptr, 'b' },
+        { "channels",   required_argument,  nullptr, 'c' },
+        { "rate",       required_argument,  nullptr, 'r' },
+        { "frames",     required_argument,  nullptr, 'n' },
+        { "help",       no_argument,        nullptr, 'h' },
+        { nullptr,      0,                  nullptr, 0 }
+    };
+
+    Options opts;
+
+    int c;
+    while ((c=getopt_long(argc, argv, "b:c:r:n:h", longopts, nullptr))!=-1) {
+        switch (c) {
+        case 'b':
+            opts.blocks=parse_list(optarg);
+            break;
+        case 'c':
+            opts.channels=parse_list(optarg);
+            break;
+        case 'r':
+            opts.rate=atoi(optarg);
+            break;
+        case 'n':
+            opts.frames=atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    bool valid=optind==argc && opts.rate>=8000 && opts.frames>0;
+
+    for (int b: opts.blocks)
+        valid&=b<=8192;
+    for (int channels: opts.channels)
+        valid&=channels<=MAX_CHANNELS;
+
+    if (!valid) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    return opts;
+}
+
+
+// the number of calls made from within the callback over all scenes
+long audit(const Options& opts, const Kernels* kernels, storage_t storage, int channels, int blocksize)
+{
+    const long before=violations;
+
+    PluginEngine plugin(channels, storage, kernels);
+    plugin.activate(opts.rate, 0);
+
+    PluginParams active;
+
+    std::vector<std::vector<float>> in(channels, std::vector<float>(blocksize));
+    std::vector<std::vector<float>> out(channels, std::vector<float>(blocksize));
+
+    const float* inputs[MAX_CHANNELS];
+    float* outputs[MAX_CHANNELS];
+
+    for (int c=0;c<channels;c++) {
+        inputs[c]=in[c].data();
+        outputs[c]=out[c].data();
+    }
+
+    uint32_t noise=0x12345678, random=0x87654321;
+
+    for (const Scene& scene: scenes()) {
+        const long frames=(long) scene.length * opts.frames;
+
+        if (!scene.random) {
+            plugin.params=scene.params;
+
+            // for these to take effect a host restarts the plugin, which
+            // is not part of the callback
+            if (scene.params.oversampling!=active.oversampling || scene.params.offline!=active.offline) {
+                plugin.activate(opts.rate, 0);
+                active=scene.params;
+            }
+        }
+
+        snprintf(context, sizeof(context), "%s, %s storage, %d channel(s), blocks of %d, %s",
+                 kernels->name, storage==STORAGE_HALF ? "half" : "float", channels, blocksize,
+                 scene.random ? "random parameters" : scene.silent ? "silence" : "");
+
+        if (!scene.random && !scene.silent) {
+            const PluginParams& p=scene.params;
+            const size_t used=strlen(context);
+
+            snprintf(context + used, sizeof(context) - used, "%d voice(s), depth %g ms, frequency %g Hz, quality %d, width %g, oversampling %dx%s",
+                     p.numvoices, p.depth, p.frequency, p.interpolation, p.width, p.oversampling, p.offline ? ", offline" : "");
+        }
+
+        for (long done=0;done<frames;done+=blocksize) {
+            const int n=(int) std::min<long>(blocksize, frames - done);
+
+            if (scene.random)
+                plugin.params=PluginParams::random(random);
+
+            for (int c=0;c<channels;c++)
+                for (int i=0;i<n;i++)
+                    in[c][i]=scene.silent ? 0.0f : (float) (xorshift(noise) >> 8) / (1<<24) - 0.5f;
+
+            inside=true;
+            plugin.run(inputs, outputs, n);
+            inside=false;
+
+            // as the UI would
+            TelemetryFrame frame;
+            while (plugin.telemetry.pop(frame));
+        }
+    }
+
+    return violations - before;
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    const Options opts=parse_options(argc, argv);
+
+    const Kernels* variants[]={
+        &baseline::kernels,
+#if defined(__x86_64__) || defined(__i386__)
+        &avx2::kernels,
+        &avx512::kernels,
+#endif
+    };
+
+    // the first backtrace loads the unwinder
+    void* frame;
+    backtrace(&frame, 1);
+
+    printf("# calls that may allocate, lock or block within the callback, at %d Hz, %d frames per change of the parameters\n",
+           opts.rate, opts.frames);
+    printf("# variant  storage channels  block     calls\n");
+
+    for (const Kernels* kernels: variants) {
+        if (!cpu_supports(*kernels))
+            continue;
+
+        for (int storage=0;storage<NUM_STORAGES;storage++) {
+            for (int channels: opts.channels) {
+                for (int blocksize: opts.blocks) {
+                    const long calls=audit(opts, kernels, (storage_t) storage, channels, blocksize);
+
+                    printf("%9s %8s %8d %6d %9ld%s\n",
+                           kernels->name, storage==STORAGE_HALF ? "half" : "float", channels, blocksize,
+                           calls, calls ? "   FAILED" : "");
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    printf("# %s\n", violations ? "FAILED" : "real-time safe");
+
+    return violations ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,687 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// headless benchmark of the Opal DSP, "make bench"; with --verify it checks
+// every kernel variant against ReferenceChorus instead
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <getopt.h>
+#include "OpalKernels.h"
+#include "OpalReference.h"
+
+using namespace StudioGemsDSP;
+
+namespace {
+
+struct Options {
+    std::vector<int>    rates { 44100, 48000, 96000, 192000, 384000 };
+    std::vector<int>    blocks { 1, 16, 64, 256, 1024, 8192 };
+    std::vector<int>    voices { 1, 4, 8 };
+
+    int     channels=1;
+    int     interpolation=INTERP_LINEAR;
+    float   depth=10.0f;
+    float   frequency=1.0f;
+    float   width=0.5f;
+    int     oversampling=1;
+    int     instances=1;
+    bool    batch=false;
+    bool    verify=false;
+
+    storage_t   storage=STORAGE_FLOAT;
+
+    double  seconds=1.0;
+    int     repeats=7;
+};
+
+
+struct Stats {
+    double  median;
+    double  min;
+    double  max;
+    double  stddev;
+};
+
+
+std::vector<int> parse_list(const char* arg)
+{
+    std::vector<int> values;
+
+    for (const char* p=arg;*p;) {
+        char* end;
+        const long value=strtol(p, &end, 10);
+
+        if (end==p || value<=0) {
+            fprintf(stderr, "invalid list '%s'\n", arg);
+            exit(EXIT_FAILURE);
+        }
+
+        values.push_back((int) value);
+
+        p=*end==',' ? end + 1 : end;
+    }
+
+    return values;
+}
+
+
+void usage(const char* name)
+{
+    printf("Usage: %s [options]\n"
+           "\n"
+           "  -r, --rates=LIST        sample rates in Hz (44100,48000,96000,192000,384000)\n"
+           "  -b, --blocks=LIST       block sizes in frames, 1 to 8192 (1,16,64,256,1024,8192)\n"
+           "  -v, --voices=LIST       voice counts, 1 to %d, ensemble above %d (1,4,8)\n"
+           "  -c, --channels=N        channels, 1 to %d (1)\n"
+           "  -q, --quality=N         interpolation, 0=linear ... 4=sinc (0)\n"
+           "  -d, --depth=MS          modulation depth in ms (10)\n"
+           "  -f, --frequency=HZ      modulation frequency in Hz (1)\n"
+           "  -w, --width=W           stereo width, 0 to 1 (0.5)\n"
+           "  -o, --oversampling=N    1, 2 or 4 (1)\n"
+           "  -m, --storage=S         delay line storage, float or half (float)\n"
+           "  -i, --instances=N       instances processing one after the other (1)\n"
+           "  -g, --batch             process the instances as one batch, mono only\n"
+           "  -s, --seconds=S         audio processed per repetition (1)\n"
+           "  -n, --repeats=N         repetitions per configuration (7)\n"
+           "  -V, --verify            compare all kernel variants with the reference instead\n"
+           "\n"
+           "Set OPAL_KERNELS=baseline|avx2|avx512 to force a kernel variant.\n",
+           name, MAX_ENSEMBLE, MAX_VOICES, MAX_CHANNELS);
+}
+
+
+Options parse_options(int argc, char** argv)
+{
+    static const option longopts[]={
+        { "rates",      required_argument,  nullptr, 'r' },
+        { "blocks",     required_argument,  nullptr, 'b' },
+        { "voices",     required_argument,  nullptr, 'v' },
+        { "channels",   required_argument,  nullptr, 'c' },
+        { "quality",    required_argument,  nullptr, 'q' },
+        { "depth",      required_argument,  nullptr, 'd' },
+        { "frequency",  required_argument,  nullptr, 'f' },
+        { "width",      required_argument,  nullptr, 'w' },
+        { "oversampling", required_argument, nullptr, 'o' },
+        { "storage",    required_argument,  nullptr, 'm' },
+        { "instances",  required_argument,  nullptr, 'i' },
+        { "batch",      no_argument,        nullptr, 'g' },
+        { "seconds",    required_argument,  nullptr, 's' },
+        { "repeats",    required_argument,  nullptr, 'n' },
+        { "verify",     no_argument,        nullptr, 'V' },
+        { "help",       no_argument,        nullptr, 'h' },
+        { nullptr,      0,                  nullptr, 0 }
+    };
+
+    Options opts;
+
+    int c;
+    while ((c=getopt_long(argc, argv, "r:b:v:c:q:d:f:w:o:m:i:gs:n:Vh", longopts, nullptr))!=-1) {
+        switch (c) {
+        case 'r':
+            opts.rates=parse_list(optarg);
+            break;
+        case 'b':
+            opts.blocks=parse_list(optarg);
+            break;
+        case 'v':
+            opts.voices=parse_list(optarg);
+            break;
+        case 'c':
+            opts.channels=atoi(optarg);
+            break;
+        case 'q':
+            opts.interpolation=atoi(optarg);
+            break;
+        case 'd':
+            opts.depth=atof(optarg);
+            break;
+        case 'f':
+            opts.frequency=atof(optarg);
+            break;
+        case 'w':
+            opts.width=atof(optarg);
+            break;
+        case 'o':
+            opts.oversampling=atoi(optarg);
+            break;
+        case 'm':
+            if (!strcmp(optarg, "half"))
+                opts.storage=STORAGE_HALF;
+            else if (strcmp(optarg, "float")) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'i':
+            opts.instances=atoi(optarg);
+            break;
+        case 'g':
+            opts.batch=true;
+            break;
+        case 's':
+            opts.seconds=atof(optarg);
+            break;
+        case 'n':
+            opts.repeats=atoi(optarg);
+            break;
+        case 'V':
+            opts.verify=true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    bool valid=opts.channels>=1 && opts.channels<=MAX_CHANNELS &&
+               opts.interpolation>=0 && opts.interpolation<NUM_INTERPOLATIONS &&
+               (opts.oversampling==1 || opts.oversampling==2 || opts.oversampling==4) &&
+               opts.instances>0 && opts.seconds>0.0 && opts.repeats>0 &&
+               (!opts.batch || (opts.channels==1 && opts.oversampling==1));
+
+    for (int b: opts.blocks)
+        valid&=b<=8192;
+    for (int v: opts.voices)
+        valid&=v>=1 && v<=(opts.batch ? MAX_VOICES : MAX_ENSEMBLE);
+
+    if (!valid) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    return opts;
+}
+
+
+Stats statistics(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+
+    const size_t n=samples.size();
+
+    double mean=0.0;
+    for (double x: samples)
+        mean+=x;
+    mean/=n;
+
+    double var=0.0;
+    for (double x: samples)
+        var+=(x-mean) * (x-mean);
+
+    Stats stats;
+    stats.median=n&1 ? samples[n/2] : (samples[n/2-1] + samples[n/2]) / 2;
+    stats.min=samples.front();
+    stats.max=samples.back();
+    stats.stddev=n>1 ? sqrt(var / (n-1)) : 0.0;
+
+    return stats;
+}
+
+
+// elapsed nanoseconds, with the parameters pushed before every block
+double run(std::vector<std::unique_ptr<Chorus>>& instances, const Options& opts, int numvoices, const std::vector<std::vector<float>>& in, std::vector<std::vector<float>>& out, int blocksize, long frames)
+{
+    const long length=(long) in[0].size();
+
+    const float* inputs[MAX_CHANNELS];
+    float* outputs[MAX_CHANNELS];
+
+    const auto start=std::chrono::steady_clock::now();
+
+    for (long done=0, pos=0;done<frames;) {
+        const int n=(int) std::min<long>(std::min<long>(blocksize, frames - done), length - pos);
+
+        for (int c=0;c<opts.channels;c++) {
+            inputs[c]=in[c].data() + pos;
+            outputs[c]=out[c].data() + pos;
+        }
+
+        for (auto& chorus: instances) {
+            chorus->set_numvoices(numvoices);
+            chorus->set_depth(opts.depth);
+            chorus->set_frequency(opts.frequency);
+            chorus->set_interpolation((interpolation_t) opts.interpolation);
+            chorus->set_width(opts.width);
+            chorus->set_oversampling(opts.oversampling);
+
+            chorus->process(inputs, outputs, n);
+        }
+
+        done+=n;
+        pos=pos + n<length ? pos + n : 0;
+    }
+
+    const auto stop=std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+
+// the same for all instances in one batch, all reading the same input
+double run(ChorusBatch& batch, const Options& opts, int numvoices, const std::vector<std::vector<float>>& in, std::vector<std::vector<float>>& out, int blocksize, long frames)
+{
+    const long length=(long) in[0].size();
+
+    std::vector<const float*> inputs(batch.get_instances());
+    std::vector<float*> outputs(batch.get_instances());
+
+    const auto start=std::chrono::steady_clock::now();
+
+    for (long done=0, pos=0;done<frames;) {
+        const int n=(int) std::min<long>(std::min<long>(blocksize, frames - done), length - pos);
+
+        for (int k=0;k<batch.get_instances();k++) {
+            inputs[k]=in[0].data() + pos;
+            outputs[k]=out[0].data() + pos;
+
+            batch.set_numvoices(k, numvoices);
+            batch.set_depth(k, opts.depth);
+            batch.set_frequency(k, opts.frequency);
+        }
+
+        batch.set_interpolation((interpolation_t) opts.interpolation);
+        batch.process(inputs.data(), outputs.data(), n);
+
+        done+=n;
+        pos=pos + n<length ? pos + n : 0;
+    }
+
+    const auto stop=std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+
+// two to three times the errors measured when the reference went in
+struct Tolerance {
+    double  max;
+    double  rms;
+    double  spectrum;   // in dB, in third octave bands within 60 dB of the loudest
+};
+
+const Tolerance TOLERANCES[NUM_INTERPOLATIONS]={
+    { 3e-3, 5e-4, 0.3 },    // linear
+    { 3e-3, 5e-4, 0.3 },    // hermite
+    { 3e-3, 5e-4, 0.3 },    // lagrange
+    { 3e-3, 5e-4, 0.3 },    // allpass
+    { 3e-3, 5e-4, 0.3 }     // sinc
+};
+
+
+struct Error {
+    double  max=0.0;
+    double  rms=0.0;
+    double  spectrum=0.0;
+
+    bool within(const Tolerance& tol) const
+    {
+        return max<=tol.max && rms<=tol.rms && spectrum<=tol.spectrum;
+    }
+};
+
+
+// in place, radix 2, the length a power of two
+void fft(std::vector<double>& re, std::vector<double>& im)
+{
+    const size_t n=re.size();
+
+    for (size_t i=1, j=0;i<n;i++) {
+        size_t bit=n >> 1;
+        for (;j & bit;bit>>=1)
+            j^=bit;
+        j^=bit;
+
+        if (i<j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    for (size_t len=2;len<=n;len<<=1) {
+        const double phi=-2.0*M_PI / len;
+
+        for (size_t i=0;i<n;i+=len) {
+            for (size_t k=0;k<len/2;k++) {
+                const double wr=cos(phi*k), wi=sin(phi*k);
+                const size_t a=i + k, b=i + k + len/2;
+
+                const double xr=re[b]*wr - im[b]*wi;
+                const double xi=re[b]*wi + im[b]*wr;
+
+                re[b]=re[a] - xr;
+                im[b]=im[a] - xi;
+                re[a]+=xr;
+                im[a]+=xi;
+            }
+        }
+    }
+}
+
+
+// third octave band powers, which smooth over the notches of the comb
+std::vector<double> spectrum(const std::vector<float>& x, int rate)
+{
+    constexpr size_t N=4096;
+
+    std::vector<double> power(N/2 + 1, 0.0);
+
+    for (size_t start=0;start + N<=x.size();start+=N/2) {
+        std::vector<double> re(N), im(N, 0.0);
+
+        for (size_t i=0;i<N;i++)
+            re[i]=x[start + i] * (0.5 - 0.5*cos(2.0*M_PI*i / N));
+
+        fft(re, im);
+
+        for (size_t k=0;k<=N/2;k++)
+            power[k]+=re[k]*re[k] + im[k]*im[k];
+    }
+
+    std::vector<double> bands;
+
+    for (double lo=20.0;lo<rate/2;lo*=pow(2.0, 1.0/3)) {
+        const size_t first=(size_t) ceil(lo * N / rate);
+        const size_t last=std::min<size_t>((size_t) ceil(lo * pow(2.0, 1.0/3) * N / rate), N/2 + 1);
+
+        double sum=0.0;
+        for (size_t k=first;k<last;k++)
+            sum+=power[k];
+
+        if (last>first)
+            bands.push_back(sum);
+    }
+
+    return bands;
+}
+
+
+Error compare(const std::vector<std::vector<float>>& out, const std::vector<std::vector<float>>& ref, int rate)
+{
+    Error error;
+    double sum=0.0;
+    size_t count=0;
+
+    for (size_t c=0;c<out.size();c++) {
+        for (size_t i=0;i<out[c].size();i++) {
+            const double d=fabs((double) out[c][i] - ref[c][i]);
+
+            error.max=std::max(error.max, d);
+            sum+=d*d;
+            count++;
+        }
+
+        const std::vector<double> p=spectrum(out[c], rate);
+        const std::vector<double> q=spectrum(ref[c], rate);
+        const double peak=*std::max_element(q.begin(), q.end());
+
+        for (size_t k=0;k<p.size();k++)
+            if (q[k]>=peak*1e-6)
+                error.spectrum=std::max(error.spectrum, fabs(10.0*log10(p[k] / q[k])));
+    }
+
+    error.rms=sqrt(sum / count);
+
+    return error;
+}
+
+
+// impulses, an exponential sweep from 20 Hz to 20 kHz or white noise, in
+// each channel shifted a little against the previous one
+std::vector<std::vector<float>> test_signal(int kind, int channels, int rate, long frames)
+{
+    std::vector<std::vector<float>> x(channels, std::vector<float>(frames, 0.0f));
+
+    uint32_t r=0x12345678;
+
+    for (int c=0;c<channels;c++) {
+        for (long i=0;i<frames;i++) {
+            if (kind==0)
+                x[c][i]=(i + 37*c) % 1009==0 ? 1.0f : 0.0f;
+            else if (kind==1) {
+                const double t=(double) (i + 11*c) / frames;
+                const double k=log(1000.0);
+                x[c][i]=(float) (0.5 * sin(2.0*M_PI*20.0*frames/rate / k * (exp(k*t) - 1.0)));
+            }
+            else {
+                r^=r<<13;
+                r^=r>>17;
+                r^=r<<5;
+                x[c][i]=(float) (r>>8) / (1<<24) - 0.5f;
+            }
+        }
+    }
+
+    return x;
+}
+
+
+// renders the signal in blocks of an odd size, so that they straddle
+// every internal chunk boundary
+template<typename ChorusT>
+std::vector<std::vector<float>> render(ChorusT& chorus, const std::vector<std::vector<float>>& in)
+{
+    constexpr long BLOCK=333;
+
+    const int channels=(int) in.size();
+    const long frames=(long) in[0].size();
+
+    std::vector<std::vector<float>> out(channels, std::vector<float>(frames));
+
+    for (long done=0;done<frames;done+=BLOCK) {
+        const uint32_t n=(uint32_t) std::min(BLOCK, frames - done);
+
+        const float* inputs[MAX_CHANNELS];
+        float* outputs[MAX_CHANNELS];
+
+        for (int c=0;c<channels;c++) {
+            inputs[c]=in[c].data() + done;
+            outputs[c]=out[c].data() + done;
+        }
+
+        chorus.process(inputs, outputs, n);
+    }
+
+    return out;
+}
+
+
+template<typename ChorusT>
+void configure(ChorusT& chorus, int numvoices, int interpolation, int oversampling)
+{
+    chorus.set_numvoices(numvoices);
+    chorus.set_depth(10.0f);
+    chorus.set_frequency(5.0f);
+    chorus.set_interpolation((interpolation_t) interpolation);
+    chorus.set_width(0.25f);
+    chorus.set_oversampling(oversampling);
+}
+
+
+// the worst errors of every configuration, and whether all are in bounds
+bool verify()
+{
+    struct Config {
+        int     channels;
+        int     voices;
+        int     oversampling;
+    };
+
+    static const Config configs[]={
+        { 1, 1, 1 }, { 1, 3, 1 }, { 1, 8, 1 }, { 1, 16, 1 }, { 1, 128, 1 },
+        { 2, 2, 1 }, { 2, 8, 1 }, { 3, 5, 1 }, { 8, 8, 1 }, { 2, 32, 1 },
+        { 1, 8, 2 }, { 1, 8, 4 }, { 2, 4, 4 }
+    };
+
+    static const char* const signals[]={ "impulses", "sweep", "noise" };
+
+    const Kernels* variants[]={
+        &baseline::kernels,
+#if defined(__x86_64__) || defined(__i386__)
+        &avx2::kernels,
+        &avx512::kernels,
+#endif
+    };
+
+    constexpr int RATE=48000;
+    constexpr long FRAMES=RATE;
+
+    printf("# kernels against the reference, %d Hz, depth 10 ms, frequency 5 Hz, width 0.25, worst of %s, %s and %s\n",
+           RATE, signals[0], signals[1], signals[2]);
+    printf("# variant  storage channels voices quality oversampling     max error     rms error  spectrum dB\n");
+
+    bool passed=true;
+
+    for (int storage=0;storage<NUM_STORAGES;storage++) {
+        for (int q=0;q<NUM_INTERPOLATIONS;q++) {
+            for (const Config& config: configs) {
+                std::vector<std::vector<float>> in[3], ref[3];
+
+                const auto reference=[&](const Kernels* kernels) {
+                    for (int s=0;s<3;s++) {
+                        ReferenceChorus reference(RATE, 0, config.channels, (storage_t) storage, kernels);
+                        configure(reference, config.voices, q, config.oversampling);
+
+                        ref[s]=render(reference, in[s]);
+                    }
+                };
+
+                for (int s=0;s<3;s++)
+                    in[s]=test_signal(s, config.channels, RATE, FRAMES);
+
+                reference(&baseline::kernels);
+
+                for (const Kernels* kernels: variants) {
+                    if (!cpu_supports(*kernels))
+                        continue;
+
+                    // the allpass restarts where the variant, with its own
+                    // rounding, moves the integer delay
+                    if (q==INTERP_ALLPASS && kernels!=&baseline::kernels)
+                        reference(kernels);
+
+                    Error worst;
+
+                    for (int s=0;s<3;s++) {
+                        Chorus chorus(RATE, 0, config.channels, (storage_t) storage, kernels);
+                        configure(chorus, config.voices, q, config.oversampling);
+
+                        const Error error=compare(render(chorus, in[s]), ref[s], RATE);
+
+                        worst.max=std::max(worst.max, error.max);
+                        worst.rms=std::max(worst.rms, error.rms);
+                        worst.spectrum=std::max(worst.spectrum, error.spectrum);
+                    }
+
+                    const bool ok=worst.within(TOLERANCES[q]);
+                    passed&=ok;
+
+                    printf("%9s %8s %8d %6d %7d %12d %13.3g %13.3g %12.4f%s\n",
+                           kernels->name, storage==STORAGE_HALF ? "half" : "float", config.channels, config.voices, q, config.oversampling,
+                           worst.max, worst.rms, worst.spectrum, ok ? "" : "   FAILED");
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    printf("# %s\n", passed ? "all within tolerance" : "FAILED");
+
+    return passed;
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    const Options opts=parse_options(argc, argv);
+
+    if (opts.verify)
+        return verify() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // white noise, long enough to keep the data out of the L1 cache, but
+    // a multiple of every block size so that blocks never straddle the end
+    const long length=1L<<16;
+
+    std::vector<std::vector<float>> in(opts.channels, std::vector<float>(length));
+    std::vector<std::vector<float>> out(opts.channels, std::vector<float>(length));
+
+    uint32_t x=0x12345678;
+    for (auto& channel: in) {
+        for (float& sample: channel) {
+            x^=x<<13;
+            x^=x>>17;
+            x^=x<<5;
+            sample=(float) (x>>8) / (1<<24) - 0.5f;
+        }
+    }
+
+    printf("# kernels %s, %s storage, %d instance(s)%s of %d channel(s), quality %d, oversampling %dx, depth %g ms, frequency %g Hz, %g s x %d repeats\n",
+           select_kernels().name, opts.storage==STORAGE_HALF ? "half" : "float", opts.instances, opts.batch ? " in a batch" : "", opts.channels,
+           opts.interpolation, opts.oversampling, opts.depth, opts.frequency, opts.seconds, opts.repeats);
+    printf("#   rate  block voices   ns/sample  ns/voice-sample   RT CPU %%   (min .. max, stddev of ns/sample)\n");
+
+    for (int rate: opts.rates) {
+        for (int blocksize: opts.blocks) {
+            for (int numvoices: opts.voices) {
+                std::vector<std::unique_ptr<Chorus>> instances;
+                std::unique_ptr<ChorusBatch> batch;
+
+                if (opts.batch)
+                    batch.reset(new ChorusBatch(rate, opts.instances, nullptr, opts.storage));
+                else
+                    for (int k=0;k<opts.instances;k++)
+                        instances.emplace_back(new Chorus(rate, k, opts.channels, opts.storage));
+
+                const long frames=(long) (opts.seconds * rate);
+                const double samples=(double) frames * opts.channels * opts.instances;
+
+                const auto pass=[&](long frames) {
+                    return batch ? run(*batch, opts, numvoices, in, out, blocksize, frames) : run(instances, opts, numvoices, in, out, blocksize, frames);
+                };
+
+                // warm up caches, branch predictors and the lazily built tables
+                pass(std::min<long>(frames, rate / 10));
+
+                std::vector<double> ns;
+                for (int r=0;r<opts.repeats;r++)
+                    ns.push_back(pass(frames) / samples);
+
+                const Stats s=statistics(ns);
+
+                // the share of the real-time budget, i.e. of 1/rate seconds per frame, of all instances
+                const double cpu=s.median * opts.channels * opts.instances * rate * 1e-9 * 100.0;
+
+                printf("%8d %6d %6d %11.2f %16.3f %10.3f   (%.2f .. %.2f, %.2f)\n",
+                       rate, blocksize, numvoices, s.median, s.median / numvoices, cpu, s.min, s.max, s.stddev);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return 0;
+}
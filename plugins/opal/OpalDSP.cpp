@@ -0,0 +1,971 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include "OpalKernels.h"
+#include "OpalSIMD.h"
+
+namespace StudioGemsDSP {
+
+
+
+
+Delay::Delay(int maxlength, int channels, storage_t storage):
+    channels(channels),
+    storage(storage)
+{
+    capacity=GUARD;
+    while (capacity<maxlength)
+        capacity*=2;
+
+    // left uninitialized, resize clears what is used; the 16-bit gathers
+    // read one element past the one they fetch
+    if (storage==STORAGE_HALF)
+        halfbuffer=new uint16_t[(capacity + GUARD)*channels + 1];
+    else
+        buffer=new float[(capacity + GUARD)*channels];
+}
+
+
+Delay::~Delay()
+{
+    delete[] buffer;
+    delete[] halfbuffer;
+}
+
+
+void Delay::resize(int minlength)
+{
+    int newlength=GUARD;
+    while (newlength<minlength && newlength<capacity)
+        newlength*=2;
+
+    if (newlength==length)
+        return;
+
+    length=newlength;
+    mask=length - 1;
+
+    clear();
+}
+
+
+void Delay::clear()
+{
+    const int size=(length + GUARD)*channels + 1;
+
+    if (storage==STORAGE_HALF)
+        memset(halfbuffer, 0, size*sizeof(uint16_t));
+    else
+        memset(buffer, 0, (size-1)*sizeof(float));
+
+    wrptr=0;
+}
+
+
+// converts n samples to half precision, eight at a time
+static void to_half(const float* input, uint16_t* output, int n)
+{
+    int i=0;
+
+    for (;i+8<=n;i+=8)
+        store_half(output + i, vfloat8::load(input + i));
+
+    if (i<n) {
+        float tail[8]={};
+        uint16_t converted[8];
+
+        memcpy(tail, input + i, (n-i)*sizeof(float));
+        store_half(converted, vfloat8::load(tail));
+        memcpy(output + i, converted, (n-i)*sizeof(uint16_t));
+    }
+}
+
+
+void Delay::write(const float* input, int frames)
+{
+    while (frames>0) {
+        int n=length - wrptr;
+        if (n>frames)
+            n=frames;
+
+        const int mirrored=wrptr<GUARD ? (n<GUARD-wrptr ? n : GUARD-wrptr) : 0;
+
+        if (storage==STORAGE_HALF) {
+            to_half(input, halfbuffer + wrptr, n);
+            memcpy(halfbuffer + length + wrptr, halfbuffer + wrptr, mirrored*sizeof(uint16_t));
+        }
+        else {
+            memcpy(buffer + wrptr, input, n*sizeof(float));
+            memcpy(buffer + length + wrptr, input, mirrored*sizeof(float));
+        }
+
+        wrptr=(wrptr+n) & mask;
+        input+=n;
+        frames-=n;
+    }
+}
+
+
+void Delay::write(const float* const* inputs, int frames)
+{
+    if (channels==1) {
+        write(inputs[0], frames);
+        return;
+    }
+
+    if (storage==STORAGE_FLOAT) {
+        for (int i=0;i<frames;i++) {
+            float* frame=buffer + wrptr*channels;
+            float* mirror=buffer + (wrptr + (length & -(wrptr<GUARD)))*channels;
+
+            for (int c=0;c<channels;c++)
+                frame[c]=mirror[c]=inputs[c][i];
+
+            wrptr=(wrptr+1) & mask;
+        }
+
+        return;
+    }
+
+    // convert each channel in pieces, then interleave
+    constexpr int PIECE=64;
+    uint16_t converted[MAX_CHANNELS][PIECE];
+
+    for (int done=0;done<frames;) {
+        const int n=frames - done<PIECE ? frames - done : PIECE;
+
+        for (int c=0;c<channels;c++)
+            to_half(inputs[c] + done, converted[c], n);
+
+        for (int i=0;i<n;i++) {
+            uint16_t* frame=halfbuffer + wrptr*channels;
+            uint16_t* mirror=halfbuffer + (wrptr + (length & -(wrptr<GUARD)))*channels;
+
+            for (int c=0;c<channels;c++)
+                frame[c]=mirror[c]=converted[c][i];
+
+            wrptr=(wrptr+1) & mask;
+        }
+
+        done+=n;
+    }
+}
+
+
+static uint32_t hash(uint32_t x)
+{
+    x^=x>>16;
+    x*=0x7feb352d;
+    x^=x>>15;
+    x*=0x846ca68b;
+    x^=x>>16;
+    return x;
+}
+
+
+BSplineNoise::BSplineNoise(uint32_t seed)
+{
+    this->seed(seed);
+}
+
+
+void BSplineNoise::seed(uint32_t seed)
+{
+    for (int j=0;j<MAX_VOICES;j++) {
+        rng[j]=hash(hash(seed) + j);
+        if (!rng[j])
+            rng[j]=0x9e3779b9;
+
+        origin[j]=rng[j];
+    }
+}
+
+
+static uint32_t xorshift(uint32_t x)
+{
+    x^=x<<13;
+    x^=x>>17;
+    x^=x<<5;
+    return x;
+}
+
+
+// the bit matrices of 2^k xorshift steps, column by column
+struct XorshiftJumps {
+    uint32_t    columns[32][32];
+
+    XorshiftJumps()
+    {
+        for (int i=0;i<32;i++)
+            columns[0][i]=xorshift(1u<<i);
+
+        for (int k=1;k<32;k++)
+            for (int i=0;i<32;i++)
+                columns[k][i]=apply(k-1, columns[k-1][i]);
+    }
+
+    uint32_t apply(int k, uint32_t x) const
+    {
+        uint32_t y=0;
+        for (int i=0;i<32;i++)
+            if (x & 1u<<i)
+                y^=columns[k][i];
+        return y;
+    }
+};
+
+
+// the generator after n steps, in at most 32 matrix products as the
+// sequence repeats after 2^32-1 steps
+static uint32_t xorshift_jump(uint32_t x, uint64_t n)
+{
+    static const XorshiftJumps jumps;
+
+    n%=0xffffffffu;
+
+    for (int k=0;n;k++, n>>=1)
+        if (n & 1)
+            x=jumps.apply(k, x);
+
+    return x;
+}
+
+
+// the control point drawn from the generator state, as in roll
+static float control_point(uint32_t x)
+{
+    return (float) (x>>12) * (1.0f / (1<<20));
+}
+
+
+void BSplineNoise::jump(int voice, uint64_t rolls)
+{
+    // the first points of a voice are zero, then come its draws in turn
+    const uint64_t skipped=rolls>4 ? rolls - 4 : 0;
+
+    uint32_t x=xorshift_jump(origin[voice], skipped);
+
+    for (int k=0;k<4;k++)
+        coeffs[k][voice]=0.0f;
+
+    for (uint64_t n=skipped;n<rolls;n++) {
+        x=xorshift(x);
+
+        for (int k=0;k<3;k++)
+            coeffs[k][voice]=coeffs[k+1][voice];
+        coeffs[3][voice]=control_point(x);
+    }
+
+    rng[voice]=x;
+    this->rolls[voice]=rolls;
+}
+
+
+void BSplineNoise::roll(int mask)
+{
+    const vfloat8 m=as_float(lanes_from_bits(mask));
+
+    const vfloat8 c1=vfloat8::load(coeffs[1]);
+    const vfloat8 c2=vfloat8::load(coeffs[2]);
+    const vfloat8 c3=vfloat8::load(coeffs[3]);
+
+    // xorshift32 step on all lanes at once
+    vint8 x=vint8::load((const int32_t*) rng);
+    x=x ^ shl<13>(x);
+    x=x ^ shr<17>(x);
+    x=x ^ shl<5>(x);
+
+    const vfloat8 next=to_float(shr<12>(x)) * vfloat8::broadcast(1.0f / (1<<20));
+
+    select(as_int(m), vint8::load(phase) - vint8::broadcast(ONE), vint8::load(phase)).store(phase);
+    select(m, c1, vfloat8::load(coeffs[0])).store(coeffs[0]);
+    select(m, c2, c1).store(coeffs[1]);
+    select(m, c3, c2).store(coeffs[2]);
+    select(m, next, c3).store(coeffs[3]);
+    select(as_int(m), x, vint8::load((const int32_t*) rng)).store((int32_t*) rng);
+
+    for (int j=0;j<MAX_VOICES;j++)
+        rolls[j]+=mask>>j & 1;
+}
+
+
+Ensemble::Ensemble(uint32_t seed)
+{
+    // every voice gets its own pair of noise voices and a blend of them
+    for (int j=0;j<MAX_ENSEMBLE;j++) {
+        first[j]=j % MAX_VOICES;
+        second[j]=(first[j] + 1 + j / MAX_VOICES % (MAX_VOICES-1)) % MAX_VOICES;
+        blend[j]=(float) (hash(hash(seed) ^ hash(j + 0x5bd1e995)) >> 8) / (1<<24);
+    }
+}
+
+
+Modulation::Modulation(int interval)
+{
+    set_interval(interval);
+}
+
+
+void Modulation::set_interval(int interval)
+{
+    this->interval=interval>0 ? interval : 1;
+
+    if (countdown>this->interval)
+        countdown=this->interval;
+}
+
+
+void Modulation::render(const Kernels& kernels, uint32_t frames, int numvoices, float maxoffset, float freq)
+{
+    for (uint32_t n=frames;n>0;) {
+        const uint32_t m=n<(uint32_t) BLOCK_SIZE ? n : BLOCK_SIZE;
+
+        kernels.render(*this, m, numvoices, maxoffset, freq);
+        n-=m;
+    }
+}
+
+
+static double sinc(double x)
+{
+    return x==0.0 ? 1.0 : sin(M_PI*x) / (M_PI*x);
+}
+
+
+SincTable::SincTable()
+{
+    float rows[SINC_PHASES+1][SINC_TAPS];
+
+    for (int p=0;p<=SINC_PHASES;p++) {
+        float sum=0.0f;
+
+        for (int j=0;j<SINC_TAPS;j++) {
+            const double x=j - SINC_TAPS/2 + (double) p / SINC_PHASES;
+            rows[p][j]=(float) (sinc(x) * sinc(x / (SINC_TAPS/2)));
+            sum+=rows[p][j];
+        }
+
+        for (int j=0;j<SINC_TAPS;j++)
+            rows[p][j]/=sum;
+    }
+
+    for (int p=0;p<SINC_PHASES;p++) {
+        for (int j=0;j<SINC_TAPS;j++) {
+            weights[p][j]=rows[p][j];
+            slopes[p][j]=rows[p+1][j] - rows[p][j];
+        }
+    }
+}
+
+
+const SincTable& sinc_table()
+{
+    static const SincTable table;
+    return table;
+}
+
+
+static double bessel_i0(double x)
+{
+    double sum=1.0, term=1.0;
+
+    for (int k=1;term>1e-12*sum;k++) {
+        term*=(x/(2*k)) * (x/(2*k));
+        sum+=term;
+    }
+
+    return sum;
+}
+
+
+HalfBandTable::HalfBandTable()
+{
+    // about 80 dB stopband attenuation
+    const double beta=8.0;
+
+    double t[HalfBand::TAPS];
+    double sum=0.0;
+
+    for (int k=0;k<HalfBand::TAPS;k++) {
+        const double x=(2*k + 1) / (2.0*HalfBand::TAPS);
+        t[k]=sinc((2*k + 1) / 2.0) / 2 * bessel_i0(beta*sqrt(1.0 - x*x)) / bessel_i0(beta);
+        sum+=t[k];
+    }
+
+    // unity gain at DC, where the centre tap contributes one half
+    for (int k=0;k<HalfBand::TAPS;k++)
+        taps[k]=(float) (t[k] * 0.25 / sum);
+}
+
+
+const HalfBandTable& halfband_table()
+{
+    static const HalfBandTable table;
+    return table;
+}
+
+
+bool cpu_supports(const Kernels& k)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (&k==&avx512::kernels)
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+    if (&k==&avx2::kernels)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+#endif
+    return &k==&baseline::kernels;
+}
+
+
+static const Kernels& detect_kernels()
+{
+    static const Kernels* const variants[]={
+#if defined(__x86_64__) || defined(__i386__)
+        &avx512::kernels,
+        &avx2::kernels,
+#endif
+        &baseline::kernels
+    };
+
+    if (const char* name=getenv("OPAL_KERNELS"))
+        for (const Kernels* k: variants)
+            if (!strcmp(k->name, name) && cpu_supports(*k))
+                return *k;
+
+    for (const Kernels* k: variants)
+        if (cpu_supports(*k))
+            return *k;
+
+    return baseline::kernels;
+}
+
+
+const Kernels& select_kernels()
+{
+    static const Kernels& kernels=detect_kernels();
+    return kernels;
+}
+
+
+HalfBand::HalfBand(int maxframes, const Kernels* kernels):
+    maxframes(maxframes),
+    kernels(kernels)
+{
+    up=new float[HISTORY + maxframes]();
+    even=new float[HISTORY + maxframes]();
+    odd=new float[HISTORY + maxframes]();
+}
+
+
+HalfBand::~HalfBand()
+{
+    delete[] up;
+    delete[] even;
+    delete[] odd;
+}
+
+
+void HalfBand::clear()
+{
+    memset(up, 0, HISTORY*sizeof(float));
+    memset(even, 0, HISTORY*sizeof(float));
+    memset(odd, 0, HISTORY*sizeof(float));
+}
+
+
+void HalfBand::upsample(const float* input, float* output, int frames)
+{
+    memcpy(up + HISTORY, input, frames*sizeof(float));
+
+    kernels->upsample(up + HISTORY, output, frames);
+
+    memmove(up, up + frames, HISTORY*sizeof(float));
+}
+
+
+void HalfBand::downsample(const float* input, float* output, int frames)
+{
+    kernels->downsample(input, even + HISTORY, odd + HISTORY, output, frames);
+
+    memmove(even, even + frames, HISTORY*sizeof(float));
+    memmove(odd, odd + frames, HISTORY*sizeof(float));
+}
+
+
+Oversampler::Oversampler(int channels, const Kernels* kernels):
+    channels(channels)
+{
+    for (int c=0;c<channels;c++) {
+        outer[c]=new HalfBand(BLOCK_SIZE, kernels);
+        inner[c]=new HalfBand(2*BLOCK_SIZE, kernels);
+
+        twice[c]=new float[2*BLOCK_SIZE];
+        buffers[c]=new float[MAX_FACTOR*BLOCK_SIZE];
+    }
+}
+
+
+Oversampler::~Oversampler()
+{
+    for (int c=0;c<channels;c++) {
+        delete outer[c];
+        delete inner[c];
+
+        delete[] twice[c];
+        delete[] buffers[c];
+    }
+}
+
+
+void Oversampler::set_factor(int factor)
+{
+    factor=factor>=4 ? 4 : factor>=2 ? 2 : 1;
+    if (factor==this->factor)
+        return;
+
+    this->factor=factor;
+
+    clear();
+}
+
+
+void Oversampler::clear()
+{
+    for (int c=0;c<channels;c++) {
+        outer[c]->clear();
+        inner[c]->clear();
+        carry[c]=0.0f;
+    }
+}
+
+
+int Oversampler::latency() const
+{
+    constexpr int T=HalfBand::TAPS;
+
+    return factor==4 ? 3*T - 1 : factor==2 ? 2*T - 1 : 0;
+}
+
+
+void Oversampler::upsample(const float* const* inputs, uint32_t frames)
+{
+    for (int c=0;c<channels;c++) {
+        if (factor==2)
+            outer[c]->upsample(inputs[c], buffers[c], frames);
+        else {
+            outer[c]->upsample(inputs[c], twice[c], frames);
+            inner[c]->upsample(twice[c], buffers[c], 2*frames);
+        }
+    }
+}
+
+
+void Oversampler::downsample(float* const* outputs, uint32_t frames)
+{
+    for (int c=0;c<channels;c++) {
+        if (factor==2)
+            outer[c]->downsample(buffers[c], outputs[c], frames);
+        else {
+            inner[c]->downsample(buffers[c], twice[c], 2*frames);
+
+            const float last=twice[c][2*frames-1];
+            memmove(twice[c] + 1, twice[c], (2*frames-1)*sizeof(float));
+            twice[c][0]=carry[c];
+            carry[c]=last;
+
+            outer[c]->downsample(twice[c], outputs[c], frames);
+        }
+    }
+}
+
+
+// the oldest sample the voices may read at the given rate, which is the
+// full depth plus the chunk written ahead of the reads and the taps
+static int reach(double rate)
+{
+    return (int) ceil(MAX_DEPTH*rate/1000) + Modulation::BLOCK_SIZE + Delay::GUARD;
+}
+
+
+Chorus::Chorus(double samplerate, uint32_t seed, int channels, storage_t storage, const Kernels* kernels):
+    samplerate(samplerate),
+    channels(channels<1 ? 1 : channels>MAX_CHANNELS ? MAX_CHANNELS : channels),
+    delay(reach(samplerate*Oversampler::MAX_FACTOR), this->channels, storage),
+    ensemble(seed),
+    oversampler(this->channels, kernels ? kernels : &select_kernels()),
+    kernels(kernels ? kernels : &select_kernels())
+{
+    delay.resize(reach(samplerate));
+
+    modulation.noise.seed(seed);
+
+    sinc_table();
+    halfband_table();
+
+    select_kernel();
+}
+
+
+void Chorus::select_kernel()
+{
+    if (numvoices>MAX_VOICES)
+        ensemble_kernel=kernels->ensemble[delay.storage][interpolation];
+    else if (channels==1)
+        kernel=kernels->voices[delay.storage][numvoices-1][interpolation];
+    else
+        kernel=kernels->channels[delay.storage][channels-2][interpolation];
+}
+
+
+void Chorus::set_numvoices(int numvoices)
+{
+    this->numvoices=numvoices<1 ? 1 : numvoices>MAX_ENSEMBLE ? MAX_ENSEMBLE : numvoices;
+
+    select_kernel();
+}
+
+
+void Chorus::set_depth(float depth)
+{
+    this->depth=depth<0.0f ? 0.0f : depth>MAX_DEPTH ? MAX_DEPTH : depth;
+}
+
+
+void Chorus::set_frequency(float frequency)
+{
+    this->frequency=frequency;
+}
+
+
+void Chorus::set_interpolation(interpolation_t interpolation)
+{
+    this->interpolation=interpolation>=0 && interpolation<NUM_INTERPOLATIONS ? interpolation : INTERP_LINEAR;
+
+    select_kernel();
+}
+
+
+void Chorus::set_width(float width)
+{
+    this->width=width<0.0f ? 0.0f : width>1.0f ? 1.0f : width;
+}
+
+
+void Chorus::set_oversampling(int factor)
+{
+    const int previous=oversampler.get_factor();
+
+    oversampler.set_factor(factor);
+
+    // keep the control rate constant in time, and the line just long
+    // enough for the new rate
+    if (oversampler.get_factor()!=previous) {
+        modulation.set_interval(16*oversampler.get_factor());
+        delay.resize(reach(samplerate*oversampler.get_factor()));
+    }
+}
+
+
+int Chorus::latency() const
+{
+    return oversampler.latency();
+}
+
+
+// the last control step before the frame is rendered, the rest set directly
+void Chorus::seek(uint64_t frame)
+{
+    const int factor=oversampler.get_factor();
+    const double rate=samplerate * factor;
+    const float maxoffset=(float) (depth*rate/1000);
+    const float freq=(float) (frequency/rate);
+    const int active=std::min(numvoices, MAX_VOICES);
+
+    const uint64_t samples=frame * factor;
+    const uint64_t steps=(samples + modulation.interval - 1) / modulation.interval;
+    const uint64_t start=steps>0 ? (steps - 1) * modulation.interval : 0;
+
+    kernels->seek(modulation, steps>0 ? steps - 1 : 0, active, maxoffset, freq);
+
+    modulation.render(*kernels, (uint32_t) (samples - start), active, maxoffset, freq);
+
+    clear();
+
+    quiet=0;
+    skipping=false;
+}
+
+
+uint32_t Chorus::preroll() const
+{
+    return 2*tail();
+}
+
+
+void Chorus::get_positions(float* positions) const
+{
+    for (int j=0;j<MAX_VOICES;j++)
+        positions[j]=modulation.noise.value[j] / 6;
+}
+
+
+void Chorus::run_kernel(const float* const* inputs, float* const* outputs, uint32_t frames, double rate)
+{
+    const float maxoffset=(float) (depth*rate/1000);
+    const float freq=(float) (frequency/rate);
+
+    if (numvoices>MAX_VOICES)
+        ensemble_kernel(delay, modulation, ensemble, inputs, outputs, frames, numvoices, maxoffset, freq, width);
+    else
+        kernel(delay, modulation, allpass, allpass_at, inputs, outputs, frames, numvoices, maxoffset, freq, width);
+}
+
+
+// input frames after which the output no longer depends on a sample, for
+// the line and the filters of the oversampler
+uint32_t Chorus::tail() const
+{
+    return delay.length / oversampler.get_factor() + 2*oversampler.latency();
+}
+
+
+static inline uint32_t magnitude_bits(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+
+    return bits & 0x7fffffff;
+}
+
+
+// whether the output of the block is silent, as the input has been for
+// at least the tail before and throughout it; NaNs count as loud
+bool Chorus::is_silent(const float* const* inputs, uint32_t frames)
+{
+    // as bit patterns, so that NaNs count as loud even with -ffast-math
+    const uint32_t silence=magnitude_bits(SILENCE);
+
+    // the loud frame last in the block, scanning back only as far as
+    // needed, so that this is cheap unless the input is quiet
+    uint32_t loud=0;
+
+    for (int c=0;c<channels;c++)
+        for (uint32_t i=frames;i>loud;i--)
+            if (magnitude_bits(inputs[c][i-1])>silence) {
+                loud=i;
+                break;
+            }
+
+    const bool silent=loud==0 && quiet>=tail();
+
+    quiet=std::min(loud ? frames - loud : quiet + frames, tail());
+
+    return silent;
+}
+
+
+// the line, the filters and the allpass states back to silence
+void Chorus::clear()
+{
+    delay.clear();
+    oversampler.clear();
+
+    for (float& state: allpass)
+        state=0.0f;
+    for (auto& channel: ensemble.allpass)
+        for (float& state: channel)
+            state=0.0f;
+}
+
+
+// writes silence and advances the modulation as the kernels would have
+void Chorus::skip(float* const* outputs, uint32_t frames)
+{
+    for (int c=0;c<channels;c++)
+        std::fill(outputs[c], outputs[c] + frames, 0.0f);
+
+    const double rate=samplerate * oversampler.get_factor();
+    const float maxoffset=(float) (depth*rate/1000);
+    const float freq=(float) (frequency/rate);
+
+    modulation.render(*kernels, frames*oversampler.get_factor(), std::min(numvoices, MAX_VOICES), maxoffset, freq);
+}
+
+
+void Chorus::process(const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+    const int factor=oversampler.get_factor();
+
+    if (is_silent(inputs, frames)) {
+        // the line and the filters only hold quiet samples by now, which
+        // are dropped, so that nothing before the silence is heard after
+        if (!skipping) {
+            clear();
+            skipping=true;
+        }
+
+        skip(outputs, frames);
+        return;
+    }
+
+    skipping=false;
+
+    if (factor==1) {
+        run_kernel(inputs, outputs, frames, samplerate);
+        return;
+    }
+
+    for (uint32_t done=0;done<frames;) {
+        const uint32_t n=frames - done<(uint32_t) Oversampler::BLOCK_SIZE ? frames - done : Oversampler::BLOCK_SIZE;
+
+        const float* input[MAX_CHANNELS];
+        float* output[MAX_CHANNELS];
+
+        for (int c=0;c<channels;c++) {
+            input[c]=inputs[c] + done;
+            output[c]=outputs[c] + done;
+        }
+
+        oversampler.upsample(input, n);
+        run_kernel(oversampler.buffers, oversampler.buffers, n*factor, samplerate*factor);
+        oversampler.downsample(output, n);
+
+        done+=n;
+    }
+}
+
+
+BatchGroup::BatchGroup(int maxlength, storage_t storage):
+    delay(maxlength, LANES, storage)
+{
+    delay.resize(maxlength);
+}
+
+
+ChorusBatch::ChorusBatch(double samplerate, int instances, const uint32_t* seeds, storage_t storage):
+    samplerate(samplerate),
+    instances(instances<1 ? 1 : instances)
+{
+    constexpr int L=BatchGroup::LANES;
+
+    numgroups=(this->instances + L - 1) / L;
+    groups=new BatchGroup*[numgroups];
+
+    for (int g=0;g<numgroups;g++)
+        groups[g]=new BatchGroup(reach(samplerate), storage);
+
+    // every lane draws the same random sequences as a Chorus with its seed
+    for (int k=0;k<this->instances;k++) {
+        BatchGroup& group=*groups[k / L];
+        const BSplineNoise source(seeds ? seeds[k] : k);
+
+        for (int j=0;j<MAX_VOICES;j++) {
+            group.modulation[j].noise.rng[k % L]=source.rng[j];
+            group.modulation[j].noise.origin[k % L]=source.origin[j];
+        }
+
+        group.numvoices[k % L]=1;
+    }
+
+    sinc_table();
+
+    kernels=&select_kernels();
+}
+
+
+ChorusBatch::~ChorusBatch()
+{
+    for (int g=0;g<numgroups;g++)
+        delete groups[g];
+
+    delete[] groups;
+}
+
+
+void ChorusBatch::set_numvoices(int instance, int numvoices)
+{
+    if (instance>=0 && instance<instances)
+        groups[instance / BatchGroup::LANES]->numvoices[instance % BatchGroup::LANES]=numvoices<1 ? 1 : numvoices>MAX_VOICES ? MAX_VOICES : numvoices;
+}
+
+
+void ChorusBatch::set_depth(int instance, float depth)
+{
+    if (instance>=0 && instance<instances)
+        groups[instance / BatchGroup::LANES]->depth[instance % BatchGroup::LANES]=depth<0.0f ? 0.0f : depth>MAX_DEPTH ? MAX_DEPTH : depth;
+}
+
+
+void ChorusBatch::set_frequency(int instance, float frequency)
+{
+    if (instance>=0 && instance<instances)
+        groups[instance / BatchGroup::LANES]->frequency[instance % BatchGroup::LANES]=frequency;
+}
+
+
+void ChorusBatch::set_interpolation(interpolation_t interpolation)
+{
+    this->interpolation=interpolation>=0 && interpolation<NUM_INTERPOLATIONS ? interpolation : INTERP_LINEAR;
+}
+
+
+void ChorusBatch::process(const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+    constexpr int L=BatchGroup::LANES;
+
+    const Kernels::batch_t kernel=kernels->batch[groups[0]->delay.storage][interpolation];
+
+    for (int g=0;g<numgroups;g++) {
+        BatchGroup& group=*groups[g];
+
+        for (int k=0;k<L;k++) {
+            group.maxoffset[k]=(float) (group.depth[k]*samplerate/1000);
+            group.freq[k]=(float) (group.frequency[k]/samplerate);
+        }
+
+        const int first=g*L;
+
+        if (first + L<=instances) {
+            kernel(group, inputs + first, outputs + first, frames);
+            continue;
+        }
+
+        // a partial group reads silence and writes to a scratch buffer
+        // in its unused lanes, so it goes in chunks of their length
+        for (uint32_t done=0;done<frames;) {
+            const uint32_t n=frames - done<(uint32_t) Modulation::BLOCK_SIZE ? frames - done : Modulation::BLOCK_SIZE;
+
+            const float* input[L];
+            float* output[L];
+
+            for (int k=0;k<L;k++) {
+                input[k]=first + k<instances ? inputs[first + k] + done : silence;
+                output[k]=first + k<instances ? outputs[first + k] + done : discard;
+            }
+
+            kernel(group, input, output, n);
+
+            done+=n;
+        }
+    }
+}
+
+}
@@ -0,0 +1,366 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#ifndef INCLUDE_STUDIOGEMS_OPALDSP_H
+#define INCLUDE_STUDIOGEMS_OPALDSP_H
+
+#include <cstdint>
+
+namespace StudioGemsDSP {
+
+constexpr int MAX_VOICES=8;
+
+// the most voices of the ensemble mode, which takes over above MAX_VOICES
+constexpr int MAX_ENSEMBLE=128;
+constexpr int MAX_CHANNELS=8;
+
+// the longest modulation depth in ms
+constexpr float MAX_DEPTH=100.0f;
+
+struct Kernels;
+
+
+// sample format of the delay line; half precision is about -74 dB off and
+// slower while the line fits the cache, so only the API and tools offer it
+enum storage_t {
+    STORAGE_FLOAT,
+    STORAGE_HALF,
+    NUM_STORAGES
+};
+
+
+// power-of-two line of interleaved channels, with the first GUARD samples
+// mirrored past the end so that taps never wrap
+class Delay {
+public:
+    static constexpr int GUARD=16;
+
+    // room for maxlength samples, rounded up to the next power of two;
+    // the line is unusable until it has been resized
+    Delay(int maxlength, int channels=1, storage_t storage=STORAGE_FLOAT);
+    ~Delay();
+
+    // sets the length to the next power of two of at least minlength,
+    // at most the capacity, and clears the line if the length changed
+    void resize(int minlength);
+
+    void clear();
+
+    void write(const float* input, int frames);
+    void write(const float* const* inputs, int frames);
+
+    int         capacity;
+    int         length=0;
+    int         mask=0;
+    int         channels;
+    storage_t   storage;
+
+    float*      buffer=nullptr;
+    uint16_t*   halfbuffer=nullptr;
+
+    int     wrptr=0;
+};
+
+
+// cubic B-spline noise of all voices, one lane each, with a fixed-point
+// phase and forward differences that are refreshed every REFRESH steps
+class BSplineNoise {
+public:
+    static constexpr int REFRESH=64;
+    static constexpr int32_t ONE=1<<30;
+
+    BSplineNoise(uint32_t seed=0);
+
+    // restart the random sequences of all voices from the given seed
+    void seed(uint32_t seed);
+
+    // shift in a new random control point for every voice set in mask
+    void roll(int mask);
+
+    // puts the control points and the generator of a voice where they are
+    // after the given number of rolls from the seed
+    void jump(int voice, uint64_t rolls);
+
+    float       coeffs[4][MAX_VOICES] {};
+    int32_t     phase[MAX_VOICES] {};
+
+    uint32_t    rng[MAX_VOICES];
+
+    // the generators as seeded, and the rolls since
+    uint32_t    origin[MAX_VOICES];
+    uint64_t    rolls[MAX_VOICES] {};
+
+    // six times the value at the phase, its forward differences for the
+    // given step, and the control steps taken
+    float       value[MAX_VOICES] {};
+    float       diff[3][MAX_VOICES] {};
+    int32_t     step[MAX_VOICES] {};
+    uint32_t    steps=0;
+};
+
+
+// the noise evaluated every interval samples and ramped into offsets
+class Modulation {
+public:
+    static constexpr int BLOCK_SIZE=256;
+
+    Modulation(int interval=16);
+
+    void set_interval(int);
+
+    // advances by frames, leaving the offsets of the last BLOCK_SIZE
+    void render(const Kernels& kernels, uint32_t frames, int numvoices, float maxoffset, float freq);
+
+    BSplineNoise    noise;
+
+    float           offsets[BLOCK_SIZE][MAX_VOICES];
+
+    // control-rate state, only to be touched by the kernels
+    int     interval;
+    int     countdown=0;
+
+    float   value[MAX_VOICES] {};
+    float   increment[MAX_VOICES] {};
+    float   target[MAX_VOICES] {};
+};
+
+
+// per voice and sample on AVX2: linear 1.1 ns, Hermite 2.1, Lagrange 2.0,
+// allpass 1.2, 8-tap Lanczos sinc 7.8
+enum interpolation_t {
+    INTERP_LINEAR,
+    INTERP_HERMITE,
+    INTERP_LAGRANGE,
+    INTERP_ALLPASS,
+    INTERP_SINC,
+    NUM_INTERPOLATIONS
+};
+
+
+// voices of the ensemble mode, each a blend of two of the modulation voices,
+// so that the spline work does not grow with them; the delay reads do
+struct Ensemble {
+    Ensemble(uint32_t seed=0);
+
+    int32_t     first[MAX_ENSEMBLE];
+    int32_t     second[MAX_ENSEMBLE];
+    float       blend[MAX_ENSEMBLE];
+
+    float       allpass[MAX_CHANNELS][MAX_ENSEMBLE] {};
+    int32_t     allpass_at[MAX_CHANNELS][MAX_ENSEMBLE] {};
+};
+
+
+// input history of a half-band stage for either direction of one channel
+class HalfBand {
+public:
+    // nonzero taps on either side of the centre, for a filter length of 4*TAPS-1
+    static constexpr int TAPS=16;
+    static constexpr int HISTORY=2*TAPS - 1;
+
+    // each direction a delay of 2*TAPS-1 samples at the higher rate
+    HalfBand(int maxframes, const Kernels* kernels);
+    ~HalfBand();
+
+    void clear();
+
+    // frames samples to 2*frames samples and back, frames<=maxframes
+    void upsample(const float* input, float* output, int frames);
+    void downsample(const float* input, float* output, int frames);
+
+private:
+    int             maxframes;
+    const Kernels*  kernels;
+
+    float*  up;
+    float*  even;
+    float*  odd;
+};
+
+
+// cascaded half-band stages for 2x and 4x
+class Oversampler {
+public:
+    static constexpr int MAX_FACTOR=4;
+    static constexpr int BLOCK_SIZE=256;
+
+    Oversampler(int channels, const Kernels* kernels);
+    ~Oversampler();
+
+    // 1, 2 or 4; a change clears the filters
+    void set_factor(int);
+
+    void clear();
+
+    int get_factor() const
+    {
+        return factor;
+    }
+
+    // in samples at the base rate
+    int latency() const;
+
+    // frames<=BLOCK_SIZE, from and to the buffers at factor times the rate
+    void upsample(const float* const* inputs, uint32_t frames);
+    void downsample(float* const* outputs, uint32_t frames);
+
+    float*  buffers[MAX_CHANNELS];
+
+private:
+    int     channels;
+    int     factor=1;
+
+    HalfBand*   outer[MAX_CHANNELS];
+    HalfBand*   inner[MAX_CHANNELS];
+
+    float*      twice[MAX_CHANNELS];
+    float       carry[MAX_CHANNELS] {};
+};
+
+
+// the chorus; blocks after the input has been silent for the tail are
+// skipped, only advancing the modulation
+class Chorus {
+public:
+    // -120 dB
+    static constexpr float SILENCE=1e-6f;
+
+    // runs on the given kernel variant, or by default on select_kernels()
+    Chorus(double samplerate, uint32_t seed, int channels=1, storage_t storage=STORAGE_FLOAT, const Kernels* kernels=nullptr);
+
+    void set_numvoices(int);
+    void set_depth(float);
+    void set_frequency(float);
+    void set_interpolation(interpolation_t);
+    void set_width(float);
+    void set_oversampling(int);
+
+    // in samples, caused by oversampling
+    int latency() const;
+
+    // of the MAX_VOICES modulation voices within the depth, from 0 to 1,
+    // as of the last control step
+    void get_positions(float* positions) const;
+
+    // inputs and outputs hold one buffer per channel
+    void process(const float* const* inputs, float* const* outputs, uint32_t frames);
+
+    // to the given frame, as if the settings had not changed before it
+    void seek(uint64_t frame);
+
+    // input frames to process after seeking, before the output is exact
+    uint32_t preroll() const;
+
+private:
+    double          samplerate;
+    int             channels;
+
+    Delay           delay;
+    Modulation      modulation;
+    Ensemble        ensemble;
+    Oversampler     oversampler;
+
+    int             numvoices=1;
+    float           depth=0.0f;
+    float           frequency=0.0f;
+    interpolation_t interpolation=INTERP_LINEAR;
+    float           width=0.0f;
+
+    // the output of the last sample of every allpass, and the integer
+    // delay it was taken at
+    float           allpass[MAX_VOICES*MAX_CHANNELS] {};
+    int32_t         allpass_at[MAX_VOICES*MAX_CHANNELS] {};
+
+    // input frames in a row below SILENCE, counted up to the tail, and
+    // whether the last block was skipped
+    uint32_t        quiet=0;
+    bool            skipping=false;
+
+    const Kernels*  kernels;
+
+    void (*kernel)(Delay&, Modulation&, float* allpass, int32_t* allpass_at, const float* const* inputs, float* const* outputs, uint32_t frames, int numvoices, float maxoffset, float freq, float width);
+    void (*ensemble_kernel)(Delay&, Modulation&, Ensemble&, const float* const* inputs, float* const* outputs, uint32_t frames, int numvoices, float maxoffset, float freq, float width);
+
+    void select_kernel();
+    void run_kernel(const float* const* inputs, float* const* outputs, uint32_t frames, double rate);
+
+    uint32_t tail() const;
+    void clear();
+    bool is_silent(const float* const* inputs, uint32_t frames);
+    void skip(float* const* outputs, uint32_t frames);
+};
+
+
+// eight mono choruses of a batch, one per lane
+struct BatchGroup {
+    static constexpr int LANES=8;
+
+    BatchGroup(int maxlength, storage_t storage);
+
+    Delay           delay;
+    Modulation      modulation[MAX_VOICES];
+
+    float           allpass[MAX_VOICES][LANES] {};
+    int32_t         allpass_at[MAX_VOICES][LANES] {};
+
+    // per lane as set, unused lanes have no voices
+    int             numvoices[LANES] {};
+    float           depth[LANES] {};
+    float           frequency[LANES] {};
+
+    // per lane in samples, as passed to the kernel
+    float           maxoffset[LANES] {};
+    float           freq[LANES] {};
+};
+
+
+// many mono choruses in groups of eight, without oversampling or skipping
+// silence; pays off with fewer than eight voices
+class ChorusBatch {
+public:
+    ChorusBatch(double samplerate, int instances, const uint32_t* seeds, storage_t storage=STORAGE_FLOAT);
+    ~ChorusBatch();
+
+    int get_instances() const { return instances; }
+
+    void set_numvoices(int instance, int);
+    void set_depth(int instance, float);
+    void set_frequency(int instance, float);
+    void set_interpolation(interpolation_t);
+
+    // inputs and outputs hold one buffer per instance
+    void process(const float* const* inputs, float* const* outputs, uint32_t frames);
+
+private:
+    double          samplerate;
+    int             instances;
+
+    BatchGroup**    groups;
+    int             numgroups;
+
+    interpolation_t interpolation=INTERP_LINEAR;
+
+    const Kernels*  kernels;
+
+    // stand-ins for the lanes of the last group without an instance
+    float           silence[Modulation::BLOCK_SIZE] {};
+    float           discard[Modulation::BLOCK_SIZE];
+};
+
+}
+
+#endif
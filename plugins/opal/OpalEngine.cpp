@@ -0,0 +1,131 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "OpalEngine.h"
+
+namespace StudioGemsDSP {
+
+PluginEngine::PluginEngine(int channels, storage_t storage, const Kernels* kernels):
+    channels(channels),
+    storage(storage),
+    kernels(kernels)
+{
+}
+
+
+PluginEngine::~PluginEngine()
+{
+    deactivate();
+}
+
+
+void PluginEngine::activate(double samplerate, uint32_t seed)
+{
+    delete chorus;
+    chorus=new Chorus(samplerate, seed, channels, storage, kernels);
+
+    this->samplerate=samplerate;
+
+    // the oversampling resizes the delay line, starts the filters over
+    // and changes the latency, which cannot happen while running
+    rendering=params.offline;
+    chorus->set_oversampling(rendering ? Oversampler::MAX_FACTOR : params.oversampling);
+
+    load.reset();
+
+    input_peak=output_peak=0.0f;
+    unreported=0;
+    published=TelemetryFrame();
+}
+
+
+void PluginEngine::deactivate()
+{
+    delete chorus;
+    chorus=nullptr;
+}
+
+
+int PluginEngine::latency() const
+{
+    return chorus ? chorus->latency() : 0;
+}
+
+
+void PluginEngine::run(const float** inputs, float** outputs, uint32_t frames)
+{
+    const auto start=std::chrono::steady_clock::now();
+
+    chorus->set_numvoices(params.numvoices);
+    chorus->set_depth(params.depth);
+    chorus->set_frequency(params.frequency);
+    chorus->set_width(params.width);
+    chorus->set_interpolation(rendering ? INTERP_SINC : (interpolation_t) params.interpolation);
+
+    // before processing, as the outputs may share the buffers of the inputs
+    input_peak=peak(inputs, frames, input_peak);
+
+    chorus->process(inputs, outputs, frames);
+
+    output_peak=peak(outputs, frames, output_peak);
+    report(frames);
+
+    // time taken relative to the duration of the buffer; an offline render
+    // may take longer than real time, so it is not counted
+    if (frames>0 && !rendering) {
+        const std::chrono::duration<float> elapsed=std::chrono::steady_clock::now() - start;
+        load.record(elapsed.count() * (float) samplerate / frames);
+    }
+}
+
+
+// the largest magnitude in the buffers, or the running one if larger
+float PluginEngine::peak(const float* const* buffers, uint32_t frames, float level) const
+{
+    for (int c=0;c<channels;c++)
+        for (uint32_t i=0;i<frames;i++)
+            level=std::max(level, std::abs(buffers[c][i]));
+
+    return level;
+}
+
+
+// passes a snapshot to the UI once per interval
+void PluginEngine::report(uint32_t frames)
+{
+    unreported+=frames;
+    if (unreported<Telemetry::INTERVAL * samplerate)
+        return;
+
+    TelemetryFrame frame;
+    chorus->get_positions(frame.position);
+    frame.numvoices=std::min(params.numvoices, MAX_VOICES);
+    frame.input_peak=input_peak;
+    frame.output_peak=output_peak;
+
+    // if the UI is not draining the ring, the snapshot is simply lost
+    telemetry.push(frame);
+    published=frame;
+
+    input_peak=output_peak=0.0f;
+    unreported=0;
+}
+
+}
@@ -0,0 +1,110 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#ifndef INCLUDE_STUDIOGEMS_OPALENGINE_H
+#define INCLUDE_STUDIOGEMS_OPALENGINE_H
+
+#include "OpalDSP.h"
+#include "OpalLoad.h"
+#include "OpalTelemetry.h"
+
+namespace StudioGemsDSP {
+
+// the parameters of the plugin, as set by the host between blocks
+struct PluginParams {
+    int     numvoices=1;
+    float   depth=10.0f;
+    float   frequency=1.0f;
+    int     interpolation=INTERP_LINEAR;
+    float   width=0.5f;
+    int     oversampling=1;
+    bool    offline=false;
+
+    // any valid setting, drawn from the given xorshift state
+    static PluginParams random(uint32_t& x)
+    {
+        const auto next=[&x]() {
+            x^=x<<13;
+            x^=x>>17;
+            x^=x<<5;
+            return x;
+        };
+
+        PluginParams params;
+        params.numvoices=1 + next() % MAX_ENSEMBLE;
+        params.depth=(float) (next() % 1001) / 1000 * MAX_DEPTH;
+        params.frequency=(float) (next() % 1001) / 50;
+        params.interpolation=next() % NUM_INTERPOLATIONS;
+        params.width=(float) (next() % 1001) / 1000;
+        params.oversampling=1 << next() % 3;
+        params.offline=next() % 8==0;
+
+        return params;
+    }
+};
+
+
+// the plugin without DPF, which it delegates to, as do opal-audit and
+// opal-wcet
+class PluginEngine {
+public:
+    PluginParams    params;
+
+    LoadMeter       load;
+    Telemetry       telemetry;
+
+    // the latest snapshot, for the output parameters, as UIs that run in
+    // a process of their own, such as those of DSSI, cannot reach the ring
+    TelemetryFrame  published {};
+
+    PluginEngine(int channels, storage_t storage=STORAGE_FLOAT, const Kernels* kernels=nullptr);
+    ~PluginEngine();
+
+    // creates the chorus, which is where the oversampling and the offline
+    // mode take effect, as they change the latency
+    void activate(double samplerate, uint32_t seed);
+    void deactivate();
+
+    // of the chorus as activated
+    int latency() const;
+
+    void run(const float** inputs, float** outputs, uint32_t frames);
+
+private:
+    Chorus*         chorus=nullptr;
+
+    int             channels;
+    storage_t       storage;
+    const Kernels*  kernels;
+
+    double      samplerate=0.0;
+
+    // the offline mode as of activation: sinc and the highest oversampling
+    bool        rendering=false;
+
+    // peaks and frames since the last snapshot
+    float       input_peak=0.0f;
+    float       output_peak=0.0f;
+    uint32_t    unreported=0;
+
+    float peak(const float* const* buffers, uint32_t frames, float level) const;
+    void report(uint32_t frames);
+};
+
+}
+
+#endif
@@ -0,0 +1,1022 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <algorithm>
+#include "OpalKernels.h"
+#include "OpalSIMD.h"
+#include "OpalMacros.h"
+
+#define OPAL_KERNEL_NAME    OPAL_STRINGIFY(OPAL_KERNEL_VARIANT)
+
+namespace StudioGemsDSP {
+namespace OPAL_KERNEL_VARIANT {
+
+// the spline at the phases, and its forward differences for the step
+static inline vfloat8 refresh(BSplineNoise& noise, vint8 step)
+{
+    const vfloat8 one=vfloat8::broadcast(1.0f);
+    const vfloat8 three=vfloat8::broadcast(3.0f);
+    const vfloat8 four=vfloat8::broadcast(4.0f);
+    const vfloat8 six=vfloat8::broadcast(6.0f);
+    const vfloat8 unit=vfloat8::broadcast(1.0f / BSplineNoise::ONE);
+
+    // B-spline basis, scaled by maxoffset/6 in the caller
+    const vfloat8 c0=vfloat8::load(noise.coeffs[0]);
+    const vfloat8 c1=vfloat8::load(noise.coeffs[1]);
+    const vfloat8 c2=vfloat8::load(noise.coeffs[2]);
+    const vfloat8 c3=vfloat8::load(noise.coeffs[3]);
+
+    const vfloat8 t=to_float(vint8::load(noise.phase)) * unit;
+    const vfloat8 s=one - t;
+    const vfloat8 t2=t*t;
+    const vfloat8 t3=t2*t;
+    const vfloat8 t3x3=three*t3;
+
+    const vfloat8 value=c0*s*s*s + c1*(t3x3 - (t2+t2)*three + four) + c2*(three*(t2+t) - t3x3 + one) + c3*t3;
+
+    // the same cubic as a*t^3 + b*t^2 + c*t + d and its differences for
+    // steps of h, which are exact up to rounding
+    const vfloat8 a=c3 - c0 + three*(c1 - c2);
+    const vfloat8 b=three*(c0 + c2) - six*c1;
+    const vfloat8 c=three*(c2 - c0);
+
+    const vfloat8 h=to_float(step) * unit;
+    const vfloat8 h2=h*h;
+    const vfloat8 h3=h2*h;
+    const vfloat8 th=t*h;
+
+    (a*(three*(t*th + th*h) + h3) + b*(th + th + h2) + c*h).store(noise.diff[0]);
+    (six*a*(th*h + h3) + (b+b)*h2).store(noise.diff[1]);
+    (six*a*h3).store(noise.diff[2]);
+
+    step.store(noise.step);
+
+    return value;
+}
+
+
+// the value one step on, by the forward differences
+static inline vfloat8 advance(BSplineNoise& noise)
+{
+    const vfloat8 d1=vfloat8::load(noise.diff[0]);
+    const vfloat8 d2=vfloat8::load(noise.diff[1]);
+
+    (d1 + d2).store(noise.diff[0]);
+    (d2 + vfloat8::load(noise.diff[2])).store(noise.diff[1]);
+
+    return vfloat8::load(noise.value) + d1;
+}
+
+
+// the step of the phase per control step in fixed point, of the lanes in
+// active, from 0 to half a segment so that no lane rolls twice in a step
+static inline vint8 fixed_step(vfloat8 step, vfloat8 active)
+{
+    const vfloat8 zero=vfloat8::zero();
+    const vfloat8 half=vfloat8::broadcast(0.5f);
+
+    step=select(step>=half, half, select(step>=zero, step, zero));
+
+    return to_int(step * vfloat8::broadcast((float) BSplineNoise::ONE)) & as_int(active);
+}
+
+
+// starts the next control interval, the offsets ramping to the new targets
+static inline void control_step(Modulation& modulation, vint8 step, vfloat8 scale, vfloat8& val, vfloat8& inc)
+{
+    BSplineNoise& noise=modulation.noise;
+
+    const vint8 one=vint8::broadcast(BSplineNoise::ONE);
+
+    val=vfloat8::load(modulation.target);
+
+    const vint8 phase=vint8::load(noise.phase) + step;
+    phase.store(noise.phase);
+
+    bool due=noise.steps++ % BSplineNoise::REFRESH==0 || movemask(as_float(step==vint8::load(noise.step)))!=0xff;
+
+    // the phase stays below ONE plus half of it, so bit 30 tells a roll
+    if (const int rolled=movemask(as_float((phase & one)==one))) {
+        noise.roll(rolled);
+        due=true;
+    }
+
+    const vfloat8 value=due ? refresh(noise, step) : advance(noise);
+    value.store(noise.value);
+
+    const vfloat8 next=scale * value;
+    next.store(modulation.target);
+
+    inc=(next - val) * vfloat8::broadcast(1.0f / modulation.interval);
+    modulation.countdown=modulation.interval;
+}
+
+
+// the state after the given control steps, bit for bit as if rendered
+static void seek(Modulation& modulation, uint64_t steps, int numvoices, float maxoffset, float freq)
+{
+    BSplineNoise& noise=modulation.noise;
+
+    const vint8 step=fixed_step(vfloat8::broadcast(freq*modulation.interval), first_lanes(numvoices));
+
+    int32_t s[MAX_VOICES];
+    step.store(s);
+
+    // numbered from zero, the step to carry the differences forward from
+    uint64_t last=steps>0 ? (steps - 1) / BSplineNoise::REFRESH * BSplineNoise::REFRESH : 0;
+
+    for (int j=0;j<MAX_VOICES;j++) {
+        const uint64_t rolls=steps * s[j] / BSplineNoise::ONE;
+
+        if (rolls>0)
+            last=std::max(last, (rolls * BSplineNoise::ONE + s[j] - 1) / s[j] - 1);
+    }
+
+    for (int j=0;j<MAX_VOICES;j++) {
+        const uint64_t position=steps>0 ? (last + 1) * s[j] : 0;
+
+        noise.jump(j, position / BSplineNoise::ONE);
+        noise.phase[j]=position % BSplineNoise::ONE;
+    }
+
+    vfloat8 value=vfloat8::zero();
+
+    if (steps>0) {
+        value=refresh(noise, step);
+
+        for (uint64_t n=last + 1;n<steps;n++) {
+            value.store(noise.value);
+            value=advance(noise);
+        }
+
+        for (int j=0;j<MAX_VOICES;j++)
+            noise.phase[j]=steps * s[j] % BSplineNoise::ONE;
+    }
+    else {
+        vint8::broadcast(0).store(noise.step);
+        for (int k=0;k<3;k++)
+            vfloat8::zero().store(noise.diff[k]);
+    }
+
+    value.store(noise.value);
+    noise.steps=(uint32_t) steps;
+
+    (vfloat8::broadcast(maxoffset / 6) * value).store(modulation.target);
+    modulation.countdown=0;
+}
+
+
+// the offsets of all lanes for the next frames samples, see control_step
+static void render_lanes(Modulation& modulation, uint32_t frames, vint8 step, vfloat8 scale)
+{
+    vfloat8 val=vfloat8::load(modulation.value);
+    vfloat8 inc=vfloat8::load(modulation.increment);
+
+    for (uint32_t i=0;i<frames;) {
+        if (modulation.countdown==0)
+            control_step(modulation, step, scale, val, inc);
+
+        uint32_t n=frames - i;
+        if (n>(uint32_t) modulation.countdown)
+            n=modulation.countdown;
+
+        modulation.countdown-=n;
+
+        for (;n>0;n--) {
+            val.store(modulation.offsets[i++]);
+            val=val + inc;
+        }
+    }
+
+    val.store(modulation.value);
+    inc.store(modulation.increment);
+}
+
+
+// voices beyond numvoices are held still
+static void render(Modulation& modulation, uint32_t frames, int numvoices, float maxoffset, float freq)
+{
+    const vint8 step=fixed_step(vfloat8::broadcast(freq*modulation.interval), first_lanes(numvoices));
+
+    render_lanes(modulation, frames, step, vfloat8::broadcast(maxoffset / 6));
+}
+
+
+// extra delay each mode needs so that it never reads ahead of the newest
+// sample, and the number of taps older than the one at the integer offset
+template<interpolation_t Q>
+struct Reach {
+    static constexpr int ahead=Q==INTERP_SINC ? SINC_TAPS/2-1 : Q==INTERP_LINEAR ? 0 : 1;
+    static constexpr int behind=Q==INTERP_SINC ? SINC_TAPS/2 : Q==INTERP_LINEAR ? 1 : 2;
+};
+
+
+// the allpass is well-behaved for fractions between 0.5 and 1.5
+template<interpolation_t Q>
+static inline vint8 split_offset(vfloat8 offset, vfloat8& t)
+{
+    const vint8 offset_int=to_int(Q==INTERP_ALLPASS ? offset - vfloat8::broadcast(0.5f) : offset);
+    t=offset - to_float(offset_int);
+    return offset_int;
+}
+
+template<interpolation_t Q>
+static inline int split_offset(float offset, float& t)
+{
+    const int offset_int=(int) (Q==INTERP_ALLPASS ? offset - 0.5f : offset);
+    t=offset - (float) offset_int;
+    return offset_int;
+}
+
+
+// the samples of the delay line in its storage format
+template<typename S>
+static inline const S* samples(const Delay& delay);
+
+template<>
+inline const float* samples<float>(const Delay& delay)
+{
+    return delay.buffer;
+}
+
+template<>
+inline const uint16_t* samples<uint16_t>(const Delay& delay)
+{
+    return delay.halfbuffer;
+}
+
+
+// reads from either storage, widened to float
+template<int n>
+static inline vfloat8 gather_samples(const float* base, vint8 idx)
+{
+    return gather_first<n>(base, idx);
+}
+
+template<int n>
+static inline vfloat8 gather_samples(const uint16_t* base, vint8 idx)
+{
+    return gather_half_first<n>(base, idx);
+}
+
+template<int n>
+static inline vfloat8 load_samples(const float* p)
+{
+    return load_first<n>(p);
+}
+
+template<int n>
+static inline vfloat8 load_samples(const uint16_t* p)
+{
+    return load_half_first<n>(p);
+}
+
+
+// taps of the first N lanes, each gathered on its own; the sinc weights are
+// only looked up for INTERP_SINC, as t goes past the table in other modes
+template<interpolation_t Q, int N, typename S>
+struct GatheredTaps {
+    const S*        buffer;
+    int             stride;
+    vint8           pos;
+
+    const SincTable&    sinc;
+    vint8               row;
+    vfloat8             r;
+
+    GatheredTaps(const S* buffer, int stride, vint8 pos, vfloat8 t, const SincTable& sinc):
+        buffer(buffer),
+        stride(stride),
+        pos(pos),
+        sinc(sinc)
+    {
+        if (Q==INTERP_SINC) {
+            const vfloat8 p=t * vfloat8::broadcast((float) SINC_PHASES);
+            row=shl<3>(to_int(p));
+            r=p - to_float(to_int(p));
+        }
+    }
+
+    vfloat8 operator()(int k) const
+    {
+        return gather_samples<N>(buffer + k*stride, pos);
+    }
+
+    vfloat8 weight(int k) const
+    {
+        const vint8 idx=row + vint8::broadcast(k);
+        return gather_first<N>(&sinc.weights[0][0], idx) + gather_first<N>(&sinc.slopes[0][0], idx)*r;
+    }
+};
+
+
+// taps of one voice on all channels, the odd ones at their own position
+template<interpolation_t Q, int C, typename S>
+struct FrameTaps {
+    const S*        even;
+    const S*        odd;
+    int             stride;
+
+    const float*    weights[2];
+    const float*    slopes[2];
+    float           r[2];
+
+    FrameTaps(const S* even, float teven, const S* odd, float todd, int stride, const SincTable& sinc):
+        even(even),
+        odd(odd),
+        stride(stride)
+    {
+        if (Q!=INTERP_SINC)
+            return;
+
+        const float t[2]={ teven, todd };
+
+        for (int k=0;k<2;k++) {
+            const float p=t[k] * SINC_PHASES;
+            const int row=(int) p;
+
+            weights[k]=sinc.weights[row];
+            slopes[k]=sinc.slopes[row];
+            r[k]=p - (float) row;
+        }
+    }
+
+    vfloat8 operator()(int k) const
+    {
+        return interleave(load_samples<C>(even + k*stride), load_samples<C>(odd + k*stride));
+    }
+
+    vfloat8 weight(int k) const
+    {
+        return interleave(vfloat8::broadcast(weights[0][k] + slopes[0][k]*r[0]), vfloat8::broadcast(weights[1][k] + slopes[1][k]*r[1]));
+    }
+};
+
+
+// the taps are oldest first, and the position t before tap Reach<Q>::behind
+template<interpolation_t Q, typename TapsT>
+static inline vfloat8 interpolate(const TapsT& taps, vfloat8 t, vfloat8& state)
+{
+    const vfloat8 one=vfloat8::broadcast(1.0f);
+    const vfloat8 half=vfloat8::broadcast(0.5f);
+
+    if (Q==INTERP_LINEAR) {
+        const vfloat8 x0=taps(0);
+        const vfloat8 x1=taps(1);
+
+        return x1 + (x0-x1)*t;
+    }
+    else if (Q==INTERP_HERMITE) {
+        const vfloat8 x0=taps(0);
+        const vfloat8 x1=taps(1);
+        const vfloat8 x2=taps(2);
+        const vfloat8 x3=taps(3);
+
+        const vfloat8 c1=half*(x1 - x3);
+        const vfloat8 c2=x3 - vfloat8::broadcast(2.5f)*x2 + (x1+x1) - half*x0;
+        const vfloat8 c3=half*(x0 - x3) + vfloat8::broadcast(1.5f)*(x2 - x1);
+
+        return ((c3*t + c2)*t + c1)*t + x2;
+    }
+    else if (Q==INTERP_LAGRANGE) {
+        const vfloat8 x0=taps(0);
+        const vfloat8 x1=taps(1);
+        const vfloat8 x2=taps(2);
+        const vfloat8 x3=taps(3);
+
+        const vfloat8 tp1=t + one;
+        const vfloat8 tm1=t - one;
+        const vfloat8 tm2=tm1 - one;
+        const vfloat8 sixth=vfloat8::broadcast(1.0f/6);
+
+        return t*tm1*(x0*tp1 - x3*tm2)*sixth + tp1*tm2*(x2*tm1 - x1*t)*half;
+    }
+    else if (Q==INTERP_ALLPASS) {
+        const vfloat8 x0=taps(1);
+        const vfloat8 x1=taps(2);
+
+        const vfloat8 a=(one - t) / (one + t);
+
+        state=a*(x1 - state) + x0;
+        return state;
+    }
+    else {
+        vfloat8 value=vfloat8::zero();
+
+        for (int j=0;j<SINC_TAPS;j++)
+            value=value + taps(j)*taps.weight(j);
+
+        return value;
+    }
+}
+
+
+// where the integer delay has moved, the allpass state starts over from a
+// linear read, as it would ring otherwise
+template<interpolation_t Q, typename TapsT>
+static inline void reprime(const TapsT& taps, vfloat8 t, vint8 offset_int, vint8& at, vfloat8& state)
+{
+    if (Q!=INTERP_ALLPASS)
+        return;
+
+    const vfloat8 kept=as_float(offset_int==at);
+
+    if (movemask(kept)!=0xff) {
+        const vfloat8 x0=taps(0);
+        const vfloat8 x1=taps(1);
+
+        state=select(kept, state, x1 + (x0-x1)*t);
+    }
+
+    at=offset_int;
+}
+
+
+// Mono chorus with the N voices in the vector lanes
+template<int N, interpolation_t Q, typename S>
+static void process_voices(Delay& delay, Modulation& modulation, float* allpass, int32_t* allpass_at, const float* const* inputs, float* const* outputs, uint32_t frames, int, float maxoffset, float freq, float)
+{
+    const float* input=inputs[0];
+    float* output=outputs[0];
+
+    const vfloat8 active=first_lanes(N);
+    const vfloat8 lead=vfloat8::broadcast((float) Reach<Q>::ahead);
+    const vint8 mask=vint8::broadcast(delay.mask);
+    const float gain=1.0f / N;
+
+    const SincTable& sinc=sinc_table();
+
+    vfloat8 state=vfloat8::load(allpass);
+    vint8 at=vint8::load(allpass_at);
+
+    while (frames>0) {
+        uint32_t n=frames<(uint32_t) Modulation::BLOCK_SIZE ? frames : (uint32_t) Modulation::BLOCK_SIZE;
+
+        render(modulation, n, N, maxoffset, freq);
+
+        // the whole chunk is written up front, so the buffer must be at
+        // least BLOCK_SIZE samples longer than the longest delay
+        const int base=delay.wrptr;
+        delay.write(input, n);
+
+        for (uint32_t i=0;i<n;i++) {
+            vfloat8 t;
+            const vint8 offset_int=split_offset<Q>(vfloat8::load(modulation.offsets[i]) + lead, t);
+            const vint8 pos=(vint8::broadcast(base + i - Reach<Q>::behind) - offset_int) & mask;
+
+            const GatheredTaps<Q, N, S> taps(samples<S>(delay), 1, pos, t, sinc);
+            reprime<Q>(taps, t, offset_int, at, state);
+
+            const vfloat8 value=interpolate<Q>(taps, t, state);
+
+            output[i]=hsum(value & active) * gain;
+        }
+
+        output+=n;
+        input+=n;
+        frames-=n;
+    }
+
+    state.store(allpass);
+    at.store(allpass_at);
+}
+
+
+// stereo with the voices in the lanes, which beats process_channels<2>
+template<interpolation_t Q, typename S>
+static void process_stereo(Delay& delay, Modulation& modulation, float* allpass, int32_t* allpass_at, const float* const* inputs, float* const* outputs, uint32_t frames, int numvoices, float maxoffset, float freq, float width)
+{
+    static const int32_t rows[8]={ 0, 8, 16, 24, 32, 40, 48, 56 };
+
+    const vfloat8 active=first_lanes(numvoices);
+    const vfloat8 lead=vfloat8::broadcast((float) Reach<Q>::ahead);
+    const vfloat8 mean=vfloat8::broadcast(maxoffset / 2);
+    const vfloat8 swing=vfloat8::broadcast(1.0f - 2*width);
+    const vint8 mask=vint8::broadcast(delay.mask);
+    const float gain=1.0f / numvoices;
+
+    const SincTable& sinc=sinc_table();
+
+    const vint8 row=vint8::load(rows);
+    vfloat8 state[2]={ gather(allpass, row), gather(allpass + 1, row) };
+
+    int32_t a[2][MAX_VOICES];
+    for (int j=0;j<MAX_VOICES;j++)
+        for (int c=0;c<2;c++)
+            a[c][j]=allpass_at[j*MAX_CHANNELS + c];
+
+    vint8 at[2]={ vint8::load(a[0]), vint8::load(a[1]) };
+
+    uint32_t done=0;
+
+    while (done<frames) {
+        uint32_t n=frames-done<(uint32_t) Modulation::BLOCK_SIZE ? frames-done : (uint32_t) Modulation::BLOCK_SIZE;
+
+        render(modulation, n, numvoices, maxoffset, freq);
+
+        const float* input[2]={ inputs[0] + done, inputs[1] + done };
+
+        const int base=delay.wrptr;
+        delay.write(input, n);
+
+        for (uint32_t i=0;i<n;i++) {
+            const vfloat8 offset=vfloat8::load(modulation.offsets[i]);
+            const vint8 now=vint8::broadcast(base + i - Reach<Q>::behind);
+
+            vfloat8 t[2];
+            const vint8 offset_int[2]={
+                split_offset<Q>(offset + lead, t[0]),
+                split_offset<Q>(mean + (offset - mean)*swing + lead, t[1])
+            };
+
+            for (int c=0;c<2;c++) {
+                const vint8 pos=shl<1>((now - offset_int[c]) & mask);
+
+                const GatheredTaps<Q, MAX_VOICES, S> taps(samples<S>(delay) + c, 2, pos, t[c], sinc);
+                reprime<Q>(taps, t[c], offset_int[c], at[c], state[c]);
+
+                const vfloat8 value=interpolate<Q>(taps, t[c], state[c]);
+
+                outputs[c][done+i]=hsum(value & active) * gain;
+            }
+        }
+
+        done+=n;
+    }
+
+    for (int c=0;c<2;c++) {
+        float s[8];
+        state[c].store(s);
+        at[c].store(a[c]);
+
+        for (int j=0;j<MAX_VOICES;j++) {
+            allpass[j*MAX_CHANNELS + c]=s[j];
+            allpass_at[j*MAX_CHANNELS + c]=a[c][j];
+        }
+    }
+}
+
+
+// C channels in the lanes, the odd ones swinging the other way by width
+template<int C, interpolation_t Q, typename S>
+static void process_channels(Delay& delay, Modulation& modulation, float* allpass, int32_t* allpass_at, const float* const* inputs, float* const* outputs, uint32_t frames, int numvoices, float maxoffset, float freq, float width)
+{
+    if (C==2 && numvoices>2) {
+        process_stereo<Q, S>(delay, modulation, allpass, allpass_at, inputs, outputs, frames, numvoices, maxoffset, freq, width);
+        return;
+    }
+
+    const vfloat8 lead=vfloat8::broadcast((float) Reach<Q>::ahead);
+    const vfloat8 mean=vfloat8::broadcast(maxoffset / 2);
+    const vfloat8 swing=vfloat8::broadcast(1.0f - 2*width);
+    const vint8 mask=vint8::broadcast(delay.mask);
+    const vfloat8 gain=vfloat8::broadcast(1.0f / numvoices);
+
+    const SincTable& sinc=sinc_table();
+    const S* const buffer=samples<S>(delay);
+
+    vfloat8 state[MAX_VOICES];
+    vint8 at[MAX_VOICES];
+    for (int j=0;j<MAX_VOICES;j++) {
+        state[j]=vfloat8::load(allpass + j*MAX_CHANNELS);
+        at[j]=vint8::load(allpass_at + j*MAX_CHANNELS);
+    }
+
+    uint32_t done=0;
+
+    while (done<frames) {
+        uint32_t n=frames-done<(uint32_t) Modulation::BLOCK_SIZE ? frames-done : (uint32_t) Modulation::BLOCK_SIZE;
+
+        render(modulation, n, numvoices, maxoffset, freq);
+
+        const float* input[MAX_CHANNELS];
+        for (int c=0;c<C;c++)
+            input[c]=inputs[c] + done;
+
+        const int base=delay.wrptr;
+        delay.write(input, n);
+
+        for (uint32_t i=0;i<n;i++) {
+            // positions and fractions of all voices for the even and odd channels
+            const vfloat8 offset=vfloat8::load(modulation.offsets[i]);
+            const vint8 now=vint8::broadcast(base + i - Reach<Q>::behind);
+
+            vfloat8 t;
+            float teven[MAX_VOICES], todd[MAX_VOICES];
+            int32_t ieven[MAX_VOICES], iodd[MAX_VOICES];
+            int32_t peven[MAX_VOICES], podd[MAX_VOICES];
+
+            const vint8 even_int=split_offset<Q>(offset + lead, t);
+            ((now - even_int) & mask).store(peven);
+            even_int.store(ieven);
+            t.store(teven);
+
+            const vint8 odd_int=split_offset<Q>(mean + (offset - mean)*swing + lead, t);
+            ((now - odd_int) & mask).store(podd);
+            odd_int.store(iodd);
+            t.store(todd);
+
+            vfloat8 sum=vfloat8::zero();
+
+            for (int j=0;j<numvoices;j++) {
+                const FrameTaps<Q, C, S> taps(buffer + peven[j]*C, teven[j], buffer + podd[j]*C, todd[j], C, sinc);
+                const vfloat8 tj=interleave(vfloat8::broadcast(teven[j]), vfloat8::broadcast(todd[j]));
+                const vint8 offset_int=as_int(interleave(as_float(vint8::broadcast(ieven[j])), as_float(vint8::broadcast(iodd[j]))));
+
+                reprime<Q>(taps, tj, offset_int, at[j], state[j]);
+
+                sum=sum + interpolate<Q>(taps, tj, state[j]);
+            }
+
+            float frame[8];
+            (sum*gain).store(frame);
+
+            for (int c=0;c<C;c++)
+                outputs[c][done+i]=frame[c];
+        }
+
+        done+=n;
+    }
+
+    for (int j=0;j<MAX_VOICES;j++) {
+        state[j].store(allpass + j*MAX_CHANNELS);
+        at[j].store(allpass_at + j*MAX_CHANNELS);
+    }
+}
+
+
+// half-band interpolation by two, eight inputs at a time
+static void upsample(const float* x, float* output, uint32_t frames)
+{
+    constexpr int T=HalfBand::TAPS;
+
+    const float* taps=halfband_table().taps;
+
+    uint32_t n=0;
+
+    for (;n+8<=frames;n+=8) {
+        vfloat8 side=vfloat8::zero();
+
+        for (int k=0;k<T;k++)
+            side=side + vfloat8::broadcast(taps[k]) * (vfloat8::load(x + n - T + 1 + k) + vfloat8::load(x + n - T - k));
+
+        store_zipped(output + 2*n, side * vfloat8::broadcast(2.0f), vfloat8::load(x + n - T + 1));
+    }
+
+    // the taps reach before the start, which n - T would wrap around
+    for (;n<frames;n++) {
+        const float* at=x + n;
+        float side=0.0f;
+
+        for (int k=0;k<T;k++)
+            side+=taps[k] * (at[1 - T + k] + at[-T - k]);
+
+        output[2*n]=side * 2.0f;
+        output[2*n+1]=at[1 - T];
+    }
+}
+
+
+// half-band decimation by two, on the input split into even and odd
+static void downsample(const float* input, float* even, float* odd, float* output, uint32_t frames)
+{
+    constexpr int T=HalfBand::TAPS;
+
+    const float* taps=halfband_table().taps;
+
+    uint32_t n=0;
+
+    for (;n+8<=frames;n+=8) {
+        vfloat8 e, o;
+        load_unzipped(input + 2*n, e, o);
+        e.store(even + n);
+        o.store(odd + n);
+    }
+
+    for (;n<frames;n++) {
+        even[n]=input[2*n];
+        odd[n]=input[2*n+1];
+    }
+
+    for (n=0;n+8<=frames;n+=8) {
+        vfloat8 side=vfloat8::zero();
+
+        for (int k=0;k<T;k++)
+            side=side + vfloat8::broadcast(taps[k]) * (vfloat8::load(even + n - T + 1 + k) + vfloat8::load(even + n - T - k));
+
+        (side + vfloat8::load(odd + n - T) * vfloat8::broadcast(0.5f)).store(output + n);
+    }
+
+    for (;n<frames;n++) {
+        const float* at=even + n;
+        float side=0.0f;
+
+        for (int k=0;k<T;k++)
+            side+=taps[k] * (at[1 - T + k] + at[-T - k]);
+
+        output[n]=side + odd[(int) n - T] * 0.5f;
+    }
+}
+
+
+// offsets and slopes of the ensemble voices first to first+7, each a blend
+// of two noise voices
+static inline void blend_voices(const Ensemble& ensemble, const float* val, const float* inc, int first, vfloat8& voice_val, vfloat8& voice_inc)
+{
+    const vfloat8 one=vfloat8::broadcast(1.0f);
+
+    const vint8 a=vint8::load(ensemble.first + first);
+    const vint8 b=vint8::load(ensemble.second + first);
+    const vfloat8 blend=vfloat8::load(ensemble.blend + first);
+
+    voice_val=gather_first<8>(val, a)*blend + gather_first<8>(val, b)*(one - blend);
+    voice_inc=gather_first<8>(inc, a)*blend + gather_first<8>(inc, b)*(one - blend);
+}
+
+
+// the same for the first numvoices voices, rounded as process_ensemble does
+static void blend(const Ensemble& ensemble, const float* val, const float* inc, float* offsets, float* slopes, int numvoices)
+{
+    for (int first=0;first<numvoices;first+=8) {
+        vfloat8 voice_val, voice_inc;
+        blend_voices(ensemble, val, inc, first, voice_val, voice_inc);
+
+        voice_val.store(offsets + first);
+        voice_inc.store(slopes + first);
+    }
+}
+
+
+// up to MAX_ENSEMBLE voices, eight at a time, each blending two noise voices;
+// only the modulation is shared, every voice still reads the line itself
+template<interpolation_t Q, typename S>
+static void process_ensemble(Delay& delay, Modulation& modulation, Ensemble& ensemble, const float* const* inputs, float* const* outputs, uint32_t frames, int numvoices, float maxoffset, float freq, float width)
+{
+    constexpr int SEGMENT=16;
+
+    const int channels=delay.channels;
+    const int groups=(numvoices + 7) / 8;
+
+    const vfloat8 lead=vfloat8::broadcast((float) Reach<Q>::ahead);
+    const vfloat8 mean=vfloat8::broadcast(maxoffset / 2);
+    const vfloat8 swing=vfloat8::broadcast(1.0f - 2*width);
+    const vfloat8 stride=vfloat8::broadcast((float) channels);
+    const vint8 mask=vint8::broadcast(delay.mask);
+    const float gain=1.0f / numvoices;
+
+    // all noise voices are in use as the basis
+    const vint8 step=fixed_step(vfloat8::broadcast(freq*modulation.interval), first_lanes(MAX_VOICES));
+    const vfloat8 scale=vfloat8::broadcast(maxoffset / 6);
+
+    const SincTable& sinc=sinc_table();
+    const S* const buffer=samples<S>(delay);
+
+    vfloat8 val=vfloat8::load(modulation.value);
+    vfloat8 inc=vfloat8::load(modulation.increment);
+
+    vfloat8 sum[MAX_CHANNELS][SEGMENT];
+
+    uint32_t done=0;
+
+    while (done<frames) {
+        uint32_t n=frames-done<(uint32_t) Modulation::BLOCK_SIZE ? frames-done : (uint32_t) Modulation::BLOCK_SIZE;
+
+        const float* input[MAX_CHANNELS];
+        for (int c=0;c<channels;c++)
+            input[c]=inputs[c] + done;
+
+        const int base=delay.wrptr;
+        delay.write(input, n);
+
+        for (uint32_t i=0;i<n;) {
+            if (modulation.countdown==0)
+                control_step(modulation, step, scale, val, inc);
+
+            uint32_t m=n - i;
+            if (m>(uint32_t) modulation.countdown)
+                m=modulation.countdown;
+            if (m>(uint32_t) SEGMENT)
+                m=SEGMENT;
+
+            modulation.countdown-=m;
+
+            float basis_val[MAX_VOICES], basis_inc[MAX_VOICES];
+            val.store(basis_val);
+            inc.store(basis_inc);
+
+            for (int c=0;c<channels;c++)
+                for (uint32_t k=0;k<m;k++)
+                    sum[c][k]=vfloat8::zero();
+
+            for (int g=0;g<groups;g++) {
+                const int first=g*8;
+                const vfloat8 active=first_lanes(numvoices - first<8 ? numvoices - first : 8);
+
+                vfloat8 voice_val, voice_inc;
+                blend_voices(ensemble, basis_val, basis_inc, first, voice_val, voice_inc);
+
+                for (int c=0;c<channels;c++) {
+                    vfloat8 state=vfloat8::load(ensemble.allpass[c] + first);
+                    vint8 at=vint8::load(ensemble.allpass_at[c] + first);
+                    vfloat8 offset=voice_val;
+
+                    for (uint32_t k=0;k<m;k++) {
+                        const vfloat8 swung=c&1 ? mean + (offset - mean)*swing : offset;
+
+                        vfloat8 t;
+                        const vint8 offset_int=split_offset<Q>(swung + lead, t);
+                        vint8 pos=(vint8::broadcast(base + i + k - Reach<Q>::behind) - offset_int) & mask;
+
+                        // the positions stay far below 2^24, so they scale exactly as floats
+                        if (channels>1)
+                            pos=to_int(to_float(pos)*stride);
+
+                        const GatheredTaps<Q, 8, S> taps(buffer + c, channels, pos, t, sinc);
+                        reprime<Q>(taps, t, offset_int, at, state);
+
+                        const vfloat8 value=interpolate<Q>(taps, t, state);
+
+                        sum[c][k]=sum[c][k] + (value & active);
+                        offset=offset + voice_inc;
+                    }
+
+                    state.store(ensemble.allpass[c] + first);
+                    at.store(ensemble.allpass_at[c] + first);
+                }
+            }
+
+            for (int c=0;c<channels;c++)
+                for (uint32_t k=0;k<m;k++)
+                    outputs[c][done+i+k]=hsum(sum[c][k]) * gain;
+
+            for (uint32_t k=0;k<m;k++)
+                val=val + inc;
+
+            i+=m;
+        }
+
+        done+=n;
+    }
+
+    val.store(modulation.value);
+    inc.store(modulation.increment);
+}
+
+
+// the eight choruses of a batch group in the lanes, voice by voice
+template<interpolation_t Q, typename S>
+static void process_batch(BatchGroup& group, const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+    static const int32_t lane_index[8]={ 0, 1, 2, 3, 4, 5, 6, 7 };
+
+    constexpr int L=BatchGroup::LANES;
+
+    Delay& delay=group.delay;
+
+    const vfloat8 lead=vfloat8::broadcast((float) Reach<Q>::ahead);
+    const vint8 mask=vint8::broadcast(delay.mask);
+    const vint8 lanes=vint8::load(lane_index);
+    const vfloat8 numvoices=to_float(vint8::load(group.numvoices));
+    const vfloat8 scale=vfloat8::load(group.maxoffset) / vfloat8::broadcast(6.0f);
+
+    int maxvoices=0;
+    float gains[L];
+
+    for (int k=0;k<L;k++) {
+        if (group.numvoices[k]>maxvoices)
+            maxvoices=group.numvoices[k];
+
+        gains[k]=group.numvoices[k]>0 ? 1.0f / group.numvoices[k] : 0.0f;
+    }
+
+    const vfloat8 gain=vfloat8::load(gains);
+
+    const SincTable& sinc=sinc_table();
+    const S* const buffer=samples<S>(delay);
+
+    vfloat8 sum[Modulation::BLOCK_SIZE];
+
+    uint32_t done=0;
+
+    while (done<frames) {
+        uint32_t n=frames-done<(uint32_t) Modulation::BLOCK_SIZE ? frames-done : (uint32_t) Modulation::BLOCK_SIZE;
+
+        const float* input[L];
+        for (int k=0;k<L;k++)
+            input[k]=inputs[k] + done;
+
+        const int base=delay.wrptr;
+        delay.write(input, n);
+
+        for (uint32_t i=0;i<n;i++)
+            sum[i]=vfloat8::zero();
+
+        for (int j=0;j<maxvoices;j++) {
+            Modulation& modulation=group.modulation[j];
+
+            const vfloat8 active=numvoices>=vfloat8::broadcast((float) (j+1));
+            const vint8 step=fixed_step(vfloat8::load(group.freq)*vfloat8::broadcast((float) modulation.interval), active);
+
+            render_lanes(modulation, n, step, scale);
+
+            vfloat8 state=vfloat8::load(group.allpass[j]);
+            vint8 at=vint8::load(group.allpass_at[j]);
+
+            for (uint32_t i=0;i<n;i++) {
+                vfloat8 t;
+                const vint8 offset_int=split_offset<Q>(vfloat8::load(modulation.offsets[i]) + lead, t);
+                const vint8 pos=(vint8::broadcast(base + i - Reach<Q>::behind) - offset_int) & mask;
+
+                const GatheredTaps<Q, L, S> taps(buffer, L, shl<3>(pos) + lanes, t, sinc);
+                reprime<Q>(taps, t, offset_int, at, state);
+
+                const vfloat8 value=interpolate<Q>(taps, t, state);
+
+                sum[i]=sum[i] + (value & active);
+            }
+
+            state.store(group.allpass[j]);
+            at.store(group.allpass_at[j]);
+        }
+
+        for (uint32_t i=0;i<n;i++) {
+            float frame[L];
+            (sum[i]*gain).store(frame);
+
+            for (int k=0;k<L;k++)
+                outputs[k][done+i]=frame[k];
+        }
+
+        done+=n;
+    }
+}
+
+
+#define OPAL_KERNELS(fn, n, S) {   \
+    &fn<n, INTERP_LINEAR, S>,       \
+    &fn<n, INTERP_HERMITE, S>,      \
+    &fn<n, INTERP_LAGRANGE, S>,     \
+    &fn<n, INTERP_ALLPASS, S>,      \
+    &fn<n, INTERP_SINC, S> }
+
+#define OPAL_VOICE_KERNELS(S) {                                                 \
+    OPAL_KERNELS(process_voices, 1, S), OPAL_KERNELS(process_voices, 2, S),     \
+    OPAL_KERNELS(process_voices, 3, S), OPAL_KERNELS(process_voices, 4, S),     \
+    OPAL_KERNELS(process_voices, 5, S), OPAL_KERNELS(process_voices, 6, S),     \
+    OPAL_KERNELS(process_voices, 7, S), OPAL_KERNELS(process_voices, 8, S) }
+
+#define OPAL_BATCH_KERNELS(S) {     \
+    &process_batch<INTERP_LINEAR, S>,   \
+    &process_batch<INTERP_HERMITE, S>,  \
+    &process_batch<INTERP_LAGRANGE, S>, \
+    &process_batch<INTERP_ALLPASS, S>,  \
+    &process_batch<INTERP_SINC, S> }
+
+#define OPAL_ENSEMBLE_KERNELS(S) {     \
+    &process_ensemble<INTERP_LINEAR, S>,   \
+    &process_ensemble<INTERP_HERMITE, S>,  \
+    &process_ensemble<INTERP_LAGRANGE, S>, \
+    &process_ensemble<INTERP_ALLPASS, S>,  \
+    &process_ensemble<INTERP_SINC, S> }
+
+#define OPAL_CHANNEL_KERNELS(S) {                                               \
+    OPAL_KERNELS(process_channels, 2, S), OPAL_KERNELS(process_channels, 3, S), \
+    OPAL_KERNELS(process_channels, 4, S), OPAL_KERNELS(process_channels, 5, S), \
+    OPAL_KERNELS(process_channels, 6, S), OPAL_KERNELS(process_channels, 7, S), \
+    OPAL_KERNELS(process_channels, 8, S) }
+
+extern const Kernels kernels={
+    OPAL_KERNEL_NAME,
+    &render,
+    &seek,
+    &blend,
+    { OPAL_VOICE_KERNELS(float), OPAL_VOICE_KERNELS(uint16_t) },
+    { OPAL_CHANNEL_KERNELS(float), OPAL_CHANNEL_KERNELS(uint16_t) },
+    { OPAL_ENSEMBLE_KERNELS(float), OPAL_ENSEMBLE_KERNELS(uint16_t) },
+    { OPAL_BATCH_KERNELS(float), OPAL_BATCH_KERNELS(uint16_t) },
+    &upsample,
+    &downsample
+};
+
+#undef OPAL_KERNELS
+#undef OPAL_VOICE_KERNELS
+#undef OPAL_CHANNEL_KERNELS
+#undef OPAL_ENSEMBLE_KERNELS
+#undef OPAL_BATCH_KERNELS
+
+}
+}
@@ -0,0 +1,105 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#ifndef INCLUDE_STUDIOGEMS_OPALKERNELS_H
+#define INCLUDE_STUDIOGEMS_OPALKERNELS_H
+
+#include "OpalDSP.h"
+
+namespace StudioGemsDSP {
+
+// the hot loops, compiled once per instruction set from OpalKernels.cpp
+struct Kernels {
+    typedef void (*render_t)(Modulation&, uint32_t frames, int numvoices, float maxoffset, float freq);
+    typedef void (*seek_t)(Modulation&, uint64_t steps, int numvoices, float maxoffset, float freq);
+    typedef void (*blend_t)(const Ensemble&, const float* val, const float* inc, float* offsets, float* slopes, int numvoices);
+    typedef void (*process_t)(Delay&, Modulation&, float* allpass, int32_t* allpass_at, const float* const* inputs, float* const* outputs, uint32_t frames, int numvoices, float maxoffset, float freq, float width);
+    typedef void (*ensemble_t)(Delay&, Modulation&, Ensemble&, const float* const* inputs, float* const* outputs, uint32_t frames, int numvoices, float maxoffset, float freq, float width);
+    typedef void (*batch_t)(BatchGroup&, const float* const* inputs, float* const* outputs, uint32_t frames);
+
+    // the buffers point at the first new sample, preceded by HalfBand::HISTORY older ones
+    typedef void (*upsample_t)(const float* input, float* output, uint32_t frames);
+    typedef void (*downsample_t)(const float* input, float* even, float* odd, float* output, uint32_t frames);
+
+    const char* name;
+
+    render_t    render;
+
+    // to the start of a control interval, as if rendered at the given settings throughout
+    seek_t      seek;
+
+    // the offsets and slopes of the ensemble voices from those of the noise
+    // voices, as the ensemble kernels blend them, in groups of eight
+    blend_t     blend;
+
+    // mono, by storage and voice count
+    process_t   voices[NUM_STORAGES][MAX_VOICES][NUM_INTERPOLATIONS];
+
+    // multichannel, by storage and channel count starting at two
+    process_t   channels[NUM_STORAGES][MAX_CHANNELS-1][NUM_INTERPOLATIONS];
+
+    // above MAX_VOICES voices, any channel count, by storage
+    ensemble_t  ensemble[NUM_STORAGES][NUM_INTERPOLATIONS];
+
+    // batches of mono choruses, eight per group
+    batch_t     batch[NUM_STORAGES][NUM_INTERPOLATIONS];
+
+    // oversampling, frames input to 2*frames output and back
+    upsample_t      upsample;
+    downsample_t    downsample;
+};
+
+namespace baseline { extern const Kernels kernels; }
+
+#if defined(__x86_64__) || defined(__i386__)
+namespace avx2 { extern const Kernels kernels; }
+namespace avx512 { extern const Kernels kernels; }
+#endif
+
+// whether the running CPU can execute the given variant
+bool cpu_supports(const Kernels&);
+
+// the best variant for this CPU, or the one named in OPAL_KERNELS
+const Kernels& select_kernels();
+
+
+// 8-tap Lanczos sinc at SINC_PHASES fractions, with the slopes to the next
+constexpr int SINC_TAPS=8;
+constexpr int SINC_PHASES=256;
+
+struct SincTable {
+    float   weights[SINC_PHASES][SINC_TAPS];
+    float   slopes[SINC_PHASES][SINC_TAPS];
+
+    SincTable();
+};
+
+const SincTable& sinc_table();
+
+
+// Kaiser windowed half-band lowpass, taps[k] at distance 2k+1 from the centre
+struct HalfBandTable {
+    float   taps[HalfBand::TAPS];
+
+    HalfBandTable();
+};
+
+const HalfBandTable& halfband_table();
+
+}
+
+#endif
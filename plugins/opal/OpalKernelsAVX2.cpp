@@ -0,0 +1,25 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// AVX2 build of the chorus kernels, compiled with -mavx2 -mfma -mf16c (see Makefile)
+
+#if !defined(__AVX2__) || !defined(__F16C__)
+#error "OpalKernelsAVX2.cpp must be compiled with -mavx2 -mfma -mf16c"
+#endif
+
+#define OPAL_KERNEL_VARIANT avx2
+#include "OpalKernels.cpp"
@@ -0,0 +1,101 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <cmath>
+#include "OpalLoad.h"
+
+namespace StudioGemsDSP {
+
+static constexpr std::memory_order relaxed=std::memory_order_relaxed;
+
+
+void LoadMeter::record(float load)
+{
+    if (reset_pending.load(relaxed) && reset_pending.exchange(false, relaxed)) {
+        for (std::atomic<uint32_t>& bin: bins)
+            bin.store(0, relaxed);
+
+        overrun_count.store(0, relaxed);
+        peak.store(0.0f, relaxed);
+
+        sum=0.0;
+        count=0;
+        cursor=0;
+        below=0;
+    }
+
+    int bin=(int) (load * BINS_PER_UNIT);
+    if (!(bin<NUM_BINS-1))
+        bin=NUM_BINS-1;
+    if (bin<0)
+        bin=0;
+
+    // there is only one writer, so no read-modify-write is needed
+    bins[bin].store(bins[bin].load(relaxed) + 1, relaxed);
+
+    if (load>1.0f)
+        overrun_count.store(overrun_count.load(relaxed) + 1, relaxed);
+
+    if (load>peak.load(relaxed))
+        peak.store(load, relaxed);
+
+    sum+=load;
+    count++;
+    average.store((float) (sum / count), relaxed);
+
+    // the rank only grows by one per record, so the cursor moves by a bin
+    // or so; it ends on the bin holding the sample of the rank
+    if (bin<cursor)
+        below++;
+
+    const uint32_t rank=(uint32_t) ceil(0.99 * count) - 1;
+
+    while (below>rank)
+        below-=bins[--cursor].load(relaxed);
+    while (below + bins[cursor].load(relaxed)<=rank)
+        below+=bins[cursor++].load(relaxed);
+
+    // the upper edge of the bin, but never more than the maximum
+    const float edge=(cursor+1) / BINS_PER_UNIT;
+    percentile.store(cursor<NUM_BINS-1 && edge<max() ? edge : max(), relaxed);
+}
+
+
+float LoadMeter::mean() const
+{
+    return average.load(relaxed);
+}
+
+
+float LoadMeter::p99() const
+{
+    return percentile.load(relaxed);
+}
+
+
+float LoadMeter::max() const
+{
+    return peak.load(relaxed);
+}
+
+
+uint32_t LoadMeter::overruns() const
+{
+    return overrun_count.load(relaxed);
+}
+
+}
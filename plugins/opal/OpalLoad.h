@@ -0,0 +1,71 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#ifndef INCLUDE_STUDIOGEMS_OPALLOAD_H
+#define INCLUDE_STUDIOGEMS_OPALLOAD_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace StudioGemsDSP {
+
+// histogram of the time spent in the callback relative to the buffer,
+// recorded by the audio thread only
+class LoadMeter {
+public:
+    // bins of 1/128 cover loads up to 2, the last bin collects all beyond
+    static constexpr int    NUM_BINS=256;
+    static constexpr float  BINS_PER_UNIT=128.0f;
+
+    // audio thread only
+    void record(float load);
+
+    // any thread, takes effect with the next record
+    void reset()
+    {
+        reset_pending.store(true, std::memory_order_relaxed);
+    }
+
+    float mean() const;
+    float max() const;
+
+    // the 99th percentile, which record keeps up to date
+    float p99() const;
+
+    // number of buffers which took longer than their duration
+    uint32_t overruns() const;
+
+private:
+    std::atomic<uint32_t>   bins[NUM_BINS] {};
+    std::atomic<uint32_t>   overrun_count { 0 };
+    std::atomic<float>      average { 0.0f };
+    std::atomic<float>      peak { 0.0f };
+    std::atomic<float>      percentile { 0.0f };
+
+    std::atomic<bool>       reset_pending { false };
+
+    // private to the audio thread, with the bin of the 99th percentile and
+    // the number of loads in the bins below it
+    double      sum=0.0;
+    uint32_t    count=0;
+    int         cursor=0;
+    uint32_t    below=0;
+};
+
+}
+
+#endif
@@ -0,0 +1,479 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "OpalReference.h"
+#include "OpalKernels.h"
+
+namespace StudioGemsDSP {
+
+static uint32_t hash(uint32_t x)
+{
+    x^=x>>16;
+    x*=0x7feb352d;
+    x^=x>>15;
+    x*=0x846ca68b;
+    x^=x>>16;
+    return x;
+}
+
+
+// nearest half precision value, ties to even, saturating at the largest
+static double round_half(double x)
+{
+    if (x>65504.0)
+        return 65504.0;
+    if (x<-65504.0)
+        return -65504.0;
+
+    int e;
+    frexp(x, &e);
+
+    // 11 significant bits, down to the subnormal spacing of 2^-24
+    const double quantum=ldexp(1.0, e - 11>-24 ? e - 11 : -24);
+
+    return nearbyint(x / quantum) * quantum;
+}
+
+
+static double sinc(double x)
+{
+    return x==0.0 ? 1.0 : sin(M_PI*x) / (M_PI*x);
+}
+
+
+static double bessel_i0(double x)
+{
+    double sum=1.0, term=1.0;
+
+    for (int k=1;term>1e-17*sum;k++) {
+        term*=(x/(2*k)) * (x/(2*k));
+        sum+=term;
+    }
+
+    return sum;
+}
+
+
+// the half-band lowpass designed anew, so that the kernels' rounding counts
+struct HalfBandTaps {
+    static constexpr int TAPS=StudioGemsDSP::HalfBand::TAPS;
+
+    double  taps[TAPS];
+
+    HalfBandTaps()
+    {
+        const double beta=8.0;
+        double sum=0.0;
+
+        for (int k=0;k<TAPS;k++) {
+            const double x=(2*k + 1) / (2.0*TAPS);
+            taps[k]=sinc((2*k + 1) / 2.0) / 2 * bessel_i0(beta*sqrt(1.0 - x*x)) / bessel_i0(beta);
+            sum+=taps[k];
+        }
+
+        for (int k=0;k<TAPS;k++)
+            taps[k]*=0.25 / sum;
+    }
+};
+
+static const HalfBandTaps& halfband_taps()
+{
+    static const HalfBandTaps taps;
+    return taps;
+}
+
+
+// taps of the Lanczos windowed sinc, its window spanning half as many lobes
+static constexpr int LANCZOS_TAPS=8;
+
+
+ReferenceChorus::ReferenceChorus(double samplerate, uint32_t seed, int channels, storage_t storage, const Kernels* kernels):
+    samplerate(samplerate),
+    channels(channels<1 ? 1 : channels>MAX_CHANNELS ? MAX_CHANNELS : channels),
+    storage(storage),
+    kernels(kernels ? kernels : &baseline::kernels),
+    ensemble(seed)
+{
+    shadow.noise.seed(seed);
+
+    for (int j=0;j<MAX_VOICES;j++) {
+        rng[j]=hash(hash(seed) + j);
+        if (!rng[j])
+            rng[j]=0x9e3779b9;
+    }
+
+    for (int j=0;j<MAX_ENSEMBLE;j++) {
+        first[j]=j % MAX_VOICES;
+        second[j]=(first[j] + 1 + j / MAX_VOICES % (MAX_VOICES-1)) % MAX_VOICES;
+        blend[j]=(double) (hash(hash(seed) ^ hash(j + 0x5bd1e995)) >> 8) / (1<<24);
+    }
+}
+
+
+void ReferenceChorus::set_numvoices(int numvoices)
+{
+    this->numvoices=numvoices<1 ? 1 : numvoices>MAX_ENSEMBLE ? MAX_ENSEMBLE : numvoices;
+}
+
+
+void ReferenceChorus::set_depth(float depth)
+{
+    this->depth=depth<0.0f ? 0.0f : depth>MAX_DEPTH ? MAX_DEPTH : depth;
+}
+
+
+void ReferenceChorus::set_frequency(float frequency)
+{
+    this->frequency=frequency;
+}
+
+
+void ReferenceChorus::set_interpolation(interpolation_t interpolation)
+{
+    this->interpolation=interpolation>=0 && interpolation<NUM_INTERPOLATIONS ? interpolation : INTERP_LINEAR;
+}
+
+
+void ReferenceChorus::set_width(float width)
+{
+    this->width=width<0.0f ? 0.0f : width>1.0f ? 1.0f : width;
+}
+
+
+void ReferenceChorus::set_oversampling(int factor)
+{
+    factor=factor>=4 ? 4 : factor>=2 ? 2 : 1;
+    if (factor==this->factor)
+        return;
+
+    // the filters start from silence, the modulation goes on
+    this->factor=factor;
+
+    for (int c=0;c<channels;c++) {
+        outer[c]=HalfBand();
+        inner[c]=HalfBand();
+        carry[c]=0.0;
+        history[c].clear();
+    }
+
+    if (countdown>16*factor)
+        countdown=16*factor;
+
+    shadow.set_interval(16*factor);
+}
+
+
+// interpolated halfway between the samples, with the taps mirrored around
+void ReferenceChorus::HalfBand::upsample(const double* x, double* y, uint32_t frames)
+{
+    constexpr int T=HalfBandTaps::TAPS;
+
+    const double* taps=halfband_taps().taps;
+
+    const long start=(long) up.size();
+    up.insert(up.end(), x, x + frames);
+
+    const auto at=[this](long n) { return n>=0 ? up[n] : 0.0; };
+
+    for (uint32_t i=0;i<frames;i++) {
+        const long n=start + i;
+
+        double side=0.0;
+        for (int k=0;k<T;k++)
+            side+=taps[k] * (at(n - T + 1 + k) + at(n - T - k));
+
+        y[2*i]=2.0 * side;
+        y[2*i+1]=at(n - T + 1);
+    }
+}
+
+
+void ReferenceChorus::HalfBand::downsample(const double* x, double* y, uint32_t frames)
+{
+    constexpr int T=HalfBandTaps::TAPS;
+
+    const double* taps=halfband_taps().taps;
+
+    const long start=(long) down.size() / 2;
+    down.insert(down.end(), x, x + 2*frames);
+
+    const auto even=[this](long n) { return n>=0 ? down[2*n] : 0.0; };
+    const auto odd=[this](long n) { return n>=0 ? down[2*n+1] : 0.0; };
+
+    for (uint32_t i=0;i<frames;i++) {
+        const long n=start + i;
+
+        double side=0.0;
+        for (int k=0;k<T;k++)
+            side+=taps[k] * (even(n - T + 1 + k) + even(n - T - k));
+
+        y[i]=side + 0.5*odd(n - T);
+    }
+}
+
+
+// a control step: every active noise voice moves on, rolling over to the
+// next control point when its phase passes one
+void ReferenceChorus::advance(double rate)
+{
+    const int interval=16*factor;
+    const double step=frequency * interval / rate;
+
+    for (int j=0;j<MAX_VOICES;j++) {
+        previous[j]=target[j];
+
+        if (numvoices<=MAX_VOICES && j>=numvoices)
+            continue;
+
+        phase[j]+=step;
+
+        while (phase[j]>=1.0) {
+            uint32_t x=rng[j];
+            x^=x<<13;
+            x^=x>>17;
+            x^=x<<5;
+            rng[j]=x;
+
+            points[0][j]=points[1][j];
+            points[1][j]=points[2][j];
+            points[2][j]=points[3][j];
+            points[3][j]=(double) (x>>12) / (1<<20);
+
+            phase[j]-=1.0;
+        }
+
+        // uniform cubic B-spline
+        const double t=phase[j];
+        const double s=1.0 - t;
+
+        target[j]=depth*rate/1000 * (points[0][j]*s*s*s +
+                                     points[1][j]*(3*t*t*t - 6*t*t + 4) +
+                                     points[2][j]*(-3*t*t*t + 3*t*t + 3*t + 1) +
+                                     points[3][j]*t*t*t) / 6;
+    }
+
+    countdown=interval;
+}
+
+
+// the float offsets of the voices one sample on, as the kernels ramp them;
+// the ensemble blends its voices anew at every segment, which ends at a
+// control step, after 16 samples or with the left samples of the block
+void ReferenceChorus::follow(float* offsets, uint32_t left, float maxoffset, float freq)
+{
+    if (numvoices<=MAX_VOICES) {
+        kernels->render(shadow, 1, numvoices, maxoffset, freq);
+
+        for (int j=0;j<numvoices;j++)
+            offsets[j]=shadow.offsets[0][j];
+        return;
+    }
+
+    kernels->render(shadow, 1, MAX_VOICES, maxoffset, freq);
+
+    if (segment_left==0) {
+        kernels->blend(ensemble, shadow.offsets[0], shadow.increment, segment, segment_inc, numvoices);
+        segment_left=std::min<uint32_t>(std::min(left, (uint32_t) shadow.countdown + 1), 16);
+    }
+
+    for (int j=0;j<numvoices;j++) {
+        offsets[j]=segment[j];
+        segment[j]=segment[j] + segment_inc[j];
+    }
+
+    segment_left--;
+}
+
+
+// voice j of channel c at the given offset of its modulation, with the
+// allpass split at the float offset of the kernels
+double ReferenceChorus::voice(int c, int j, double offset, float split)
+{
+    const std::vector<double>& x=history[c];
+    const long now=(long) x.size() - 1;
+
+    if (c&1) {
+        const double mean=depth*samplerate*factor/1000 / 2;
+        offset=mean + (offset - mean)*(1.0 - 2*width);
+    }
+
+    // taps needed ahead of and behind the interpolated position, which is
+    // t samples before tap number behind
+    const int ahead=interpolation==INTERP_SINC ? LANCZOS_TAPS/2-1 : interpolation==INTERP_LINEAR ? 0 : 1;
+    const int behind=interpolation==INTERP_SINC ? LANCZOS_TAPS/2 : interpolation==INTERP_LINEAR ? 1 : 2;
+
+    const double delay=offset + ahead;
+    const long whole=interpolation==INTERP_ALLPASS ? (long) (split + (float) ahead - 0.5f) : (long) delay;
+    const double t=delay - whole;
+
+    const auto tap=[&](int k) {
+        const long n=now - whole - behind + k;
+        return n>=0 && n<=now ? x[n] : 0.0;
+    };
+
+    switch (interpolation) {
+    case INTERP_LINEAR:
+        return tap(1) + (tap(0) - tap(1))*t;
+    case INTERP_HERMITE: {
+        const double c1=0.5*(tap(1) - tap(3));
+        const double c2=tap(3) - 2.5*tap(2) + 2*tap(1) - 0.5*tap(0);
+        const double c3=0.5*(tap(0) - tap(3)) + 1.5*(tap(2) - tap(1));
+
+        return ((c3*t + c2)*t + c1)*t + tap(2);
+    }
+    case INTERP_LAGRANGE:
+        return t*(t-1)*(tap(0)*(t+1) - tap(3)*(t-2))/6 + (t+1)*(t-2)*(tap(2)*(t-1) - tap(1)*t)/2;
+    case INTERP_ALLPASS: {
+        const double a=(1.0 - t) / (1.0 + t);
+
+        // where the integer delay moved, the state starts over from the
+        // line, at the last sample's position
+        if (whole!=allpass_at[c][j])
+            allpass[c][j]=tap(1) + (tap(0) - tap(1))*t;
+        allpass_at[c][j]=whole;
+
+        allpass[c][j]=a*(tap(2) - allpass[c][j]) + tap(1);
+        return allpass[c][j];
+    }
+    default: {
+        double weights[LANCZOS_TAPS], sum=0.0;
+
+        for (int k=0;k<LANCZOS_TAPS;k++)
+            sum+=weights[k]=sinc(k - behind + t) * sinc((k - behind + t) / (LANCZOS_TAPS/2));
+
+        double value=0.0;
+        for (int k=0;k<LANCZOS_TAPS;k++)
+            value+=weights[k] * tap(k);
+
+        return value / sum;
+    }
+    }
+}
+
+
+void ReferenceChorus::run(const double* const* inputs, double* const* outputs, uint32_t frames, double rate)
+{
+    const int interval=16*factor;
+
+    const float maxoffset=(float) (depth*rate/1000);
+    const float freq=(float) (frequency/rate);
+    const float mean=maxoffset / 2;
+    const float swing=1.0f - 2*(float) width;
+
+    segment_left=0;
+
+    for (uint32_t i=0;i<frames;i++) {
+        for (int c=0;c<channels;c++)
+            history[c].push_back(storage==STORAGE_HALF ? round_half((float) inputs[c][i]) : inputs[c][i]);
+
+        float split[MAX_ENSEMBLE];
+        follow(split, std::min<uint32_t>(frames - i, Modulation::BLOCK_SIZE - i % Modulation::BLOCK_SIZE), maxoffset, freq);
+
+        if (countdown==0)
+            advance(rate);
+
+        // the offsets ramp linearly between the control steps
+        const double ramp=(double) (interval - countdown) / interval;
+        countdown--;
+
+        double offsets[MAX_VOICES];
+        for (int j=0;j<MAX_VOICES;j++)
+            offsets[j]=previous[j] + (target[j] - previous[j])*ramp;
+
+        for (int c=0;c<channels;c++) {
+            double sum=0.0;
+
+            for (int j=0;j<numvoices;j++) {
+                const double offset=numvoices>MAX_VOICES ? blend[j]*offsets[first[j]] + (1.0 - blend[j])*offsets[second[j]] : offsets[j];
+
+                sum+=voice(c, j, offset, c&1 ? mean + (split[j] - mean)*swing : split[j]);
+            }
+
+            outputs[c][i]=sum / numvoices;
+        }
+    }
+}
+
+
+void ReferenceChorus::process(const float* const* inputs, float* const* outputs, uint32_t frames)
+{
+    std::vector<double> in[MAX_CHANNELS], out[MAX_CHANNELS], twice[MAX_CHANNELS];
+    const double* input[MAX_CHANNELS];
+    double* output[MAX_CHANNELS];
+
+    for (int c=0;c<channels;c++) {
+        in[c].assign(inputs[c], inputs[c] + frames);
+        out[c].resize(factor*frames);
+        twice[c].resize(2*frames);
+
+        if (factor==2)
+            outer[c].upsample(in[c].data(), out[c].data(), frames);
+        else if (factor==4) {
+            outer[c].upsample(in[c].data(), twice[c].data(), frames);
+            inner[c].upsample(twice[c].data(), out[c].data(), 2*frames);
+        }
+        else
+            out[c]=in[c];
+
+        input[c]=out[c].data();
+        output[c]=out[c].data();
+    }
+
+    // each voice only reads the history, so the output may overwrite the
+    // input; in the pieces the kernels get, as the ensemble segments end there
+    const uint32_t piece=factor>1 ? Oversampler::BLOCK_SIZE*factor : frames;
+
+    for (uint32_t done=0;done<factor*frames;done+=piece) {
+        const double* in_piece[MAX_CHANNELS];
+        double* out_piece[MAX_CHANNELS];
+
+        for (int c=0;c<channels;c++) {
+            in_piece[c]=input[c] + done;
+            out_piece[c]=output[c] + done;
+        }
+
+        run(in_piece, out_piece, std::min(piece, factor*frames - done), samplerate*factor);
+    }
+
+    for (int c=0;c<channels;c++) {
+        std::vector<double> result(frames);
+
+        if (factor==2)
+            outer[c].downsample(out[c].data(), result.data(), frames);
+        else if (factor==4) {
+            inner[c].downsample(out[c].data(), twice[c].data(), 2*frames);
+
+            // one sample of delay at 2x, for a whole number of samples in all
+            const double last=twice[c][2*frames-1];
+            for (uint32_t i=2*frames-1;i>0;i--)
+                twice[c][i]=twice[c][i-1];
+            twice[c][0]=carry[c];
+            carry[c]=last;
+
+            outer[c].downsample(twice[c].data(), result.data(), frames);
+        }
+        else
+            result=out[c];
+
+        for (uint32_t i=0;i<frames;i++)
+            outputs[c][i]=(float) result[i];
+    }
+}
+
+}
@@ -0,0 +1,106 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#ifndef INCLUDE_STUDIOGEMS_OPALREFERENCE_H
+#define INCLUDE_STUDIOGEMS_OPALREFERENCE_H
+
+#include <vector>
+#include "OpalDSP.h"
+
+namespace StudioGemsDSP {
+
+// scalar double-precision model of the Chorus for "opalbench --verify"; the old
+// scalar chorus had none of the modes, the generator or the control rate to
+// stand in for it; change it only in commits of its own, when the sound does
+class ReferenceChorus {
+public:
+    // the allpass restarts where the given variant moves its integer delay,
+    // by default where the baseline does
+    ReferenceChorus(double samplerate, uint32_t seed, int channels=1, storage_t storage=STORAGE_FLOAT, const Kernels* kernels=nullptr);
+
+    void set_numvoices(int);
+    void set_depth(float);
+    void set_frequency(float);
+    void set_interpolation(interpolation_t);
+    void set_width(float);
+    void set_oversampling(int);
+
+    void process(const float* const* inputs, float* const* outputs, uint32_t frames);
+
+private:
+    // one half-band stage of one channel, keeping all of its input in
+    // either direction
+    struct HalfBand {
+        std::vector<double> up;
+        std::vector<double> down;
+
+        void upsample(const double* x, double* y, uint32_t frames);
+        void downsample(const double* x, double* y, uint32_t frames);
+    };
+
+    double          samplerate;
+    int             channels;
+    storage_t       storage;
+
+    int             numvoices=1;
+    double          depth=0.0;
+    double          frequency=0.0;
+    interpolation_t interpolation=INTERP_LINEAR;
+    double          width=0.0;
+    int             factor=1;
+
+    // the input at the rate of the voices, from the start
+    std::vector<double> history[MAX_CHANNELS];
+
+    // the noise, and the control interval it is evaluated at
+    double          phase[MAX_VOICES] {};
+    double          points[4][MAX_VOICES] {};
+    uint32_t        rng[MAX_VOICES];
+
+    int             countdown=0;
+    double          previous[MAX_VOICES] {};
+    double          target[MAX_VOICES] {};
+
+    int             first[MAX_ENSEMBLE];
+    int             second[MAX_ENSEMBLE];
+    double          blend[MAX_ENSEMBLE];
+
+    double          allpass[MAX_CHANNELS][MAX_ENSEMBLE] {};
+    long            allpass_at[MAX_CHANNELS][MAX_ENSEMBLE] {};
+
+    // the offsets of the kernels in float, only to split the allpass delay
+    // as they do, and the ramps of the ensemble segment in progress
+    const Kernels*  kernels;
+    Modulation      shadow;
+    Ensemble        ensemble;
+    float           segment[MAX_ENSEMBLE];
+    float           segment_inc[MAX_ENSEMBLE];
+    uint32_t        segment_left=0;
+
+    HalfBand        outer[MAX_CHANNELS];
+    HalfBand        inner[MAX_CHANNELS];
+    double          carry[MAX_CHANNELS] {};
+
+    void advance(double rate);
+    void follow(float* offsets, uint32_t left, float maxoffset, float freq);
+    double voice(int c, int j, double offset, float split);
+    void run(const double* const* inputs, double* const* outputs, uint32_t frames, double rate);
+};
+
+}
+
+#endif
@@ -0,0 +1,857 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// offline renderer for WAV and RF64 files on the C interface, "make render";
+// both files are memory-mapped, and --jobs renders chunks in parallel
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "OpalAPI.h"
+
+namespace {
+
+enum sample_t {
+    SAMPLE_INT16,
+    SAMPLE_INT24,
+    SAMPLE_INT32,
+    SAMPLE_FLOAT32,
+    NUM_SAMPLE_TYPES
+};
+
+const char* const SAMPLE_NAMES[NUM_SAMPLE_TYPES]={ "int16", "int24", "int32", "float" };
+const int SAMPLE_BYTES[NUM_SAMPLE_TYPES]={ 2, 3, 4, 4 };
+
+
+// a value over time, linear between the points and held before and after
+struct Automation {
+    opal_param_t    param;
+
+    std::vector<double> times;
+    std::vector<float>  values;
+
+    float at(double t) const
+    {
+        if (t<=times.front())
+            return values.front();
+
+        for (size_t k=1;k<times.size();k++)
+            if (t<times[k])
+                return values[k-1] + (values[k] - values[k-1]) * (float) ((t - times[k-1]) / (times[k] - times[k-1]));
+
+        return values.back();
+    }
+};
+
+
+struct Options {
+    float   params[OPAL_NUM_PARAMS]={ 1.0f, 10.0f, 1.0f, 0.0f, 0.5f, 1.0f };
+
+    opal_storage_t  storage=OPAL_STORAGE_FLOAT;
+    uint32_t        seed=0;
+
+    // as the input unless given
+    int     format=-1;
+
+    // threads rendering chunks of the file, 0 for one per core
+    unsigned    jobs=1;
+
+    std::vector<Automation> automations;
+
+    const char* input;
+    const char* output;
+};
+
+
+void usage(const char* name)
+{
+    printf("Usage: %s [options] INPUT OUTPUT\n"
+           "\n"
+           "Runs a WAV or RF64 file through the chorus.\n"
+           "\n"
+           "  -v, --voices=N          voices, 1 to 128, ensemble above 8 (1)\n"
+           "  -d, --depth=MS          modulation depth in ms, 0 to 100 (10)\n"
+           "  -f, --frequency=HZ      modulation frequency in Hz, 0.1 to 10 (1)\n"
+           "  -w, --width=W           stereo width, 0 to 1 (0.5)\n"
+           "  -q, --quality=N         interpolation, 0=linear ... 4=sinc (0)\n"
+           "  -o, --oversampling=N    1, 2 or 4 (1)\n"
+           "  -m, --storage=S         delay line storage, float or half (float)\n"
+           "  -s, --seed=N            seed of the modulation (0)\n"
+           "  -F, --format=F          output samples, int16, int24, int32 or float (as the input)\n"
+           "  -a, --automate=CURVE    PARAM:T=V,T=V,... sets depth, freq or width to the value V\n"
+           "                          at T seconds, linear in between, may be given repeatedly\n"
+           "  -j, --jobs=N            render in N chunks in parallel, 0 for one per core (1)\n",
+           name);
+}
+
+
+float parse_number(const char* arg)
+{
+    char* end;
+    const float value=strtof(arg, &end);
+
+    if (end==arg || *end || !std::isfinite(value)) {
+        fprintf(stderr, "invalid number '%s'\n", arg);
+        exit(EXIT_FAILURE);
+    }
+
+    return value;
+}
+
+
+Automation parse_automation(const char* arg)
+{
+    static const struct {
+        const char*     symbol;
+        opal_param_t    param;
+    } symbols[]={
+        { "depth",  OPAL_PARAM_DEPTH },
+        { "freq",   OPAL_PARAM_FREQUENCY },
+        { "width",  OPAL_PARAM_WIDTH }
+    };
+
+    Automation automation;
+
+    const char* colon=strchr(arg, ':');
+    bool valid=false;
+
+    for (const auto& s: symbols) {
+        if (colon && (size_t) (colon - arg)==strlen(s.symbol) && !strncmp(arg, s.symbol, colon - arg)) {
+            automation.param=s.param;
+            valid=true;
+        }
+    }
+
+    for (const char* p=colon ? colon + 1 : arg;valid && *p;) {
+        char* end;
+        const double t=strtod(p, &end);
+        valid=end>p && *end=='=' && t>=0.0 && (automation.times.empty() || t>automation.times.back());
+
+        p=end + 1;
+        const float value=strtof(p, &end);
+        valid&=end>p && (*end==',' || !*end);
+
+        automation.times.push_back(t);
+        automation.values.push_back(value);
+
+        p=*end==',' ? end + 1 : end;
+    }
+
+    if (!valid || automation.times.empty()) {
+        fprintf(stderr, "invalid automation '%s', expected e.g. depth:0=5,30=20\n", arg);
+        exit(EXIT_FAILURE);
+    }
+
+    return automation;
+}
+
+
+Options parse_options(int argc, char** argv)
+{
+    static const option longopts[]={
+        { "voices",     required_argument,  nullptr, 'v' },
+        { "depth",      required_argument,  nullptr, 'd' },
+        { "frequency",  required_argument,  nullptr, 'f' },
+        { "width",      required_argument,  nullptr, 'w' },
+        { "quality",    required_argument,  nullptr, 'q' },
+        { "oversampling", required_argument, nullptr, 'o' },
+        { "storage",    required_argument,  nullptr, 'm' },
+        { "seed",       required_argument,  nullptr, 's' },
+        { "format",     required_argument,  nullptr, 'F' },
+        { "automate",   required_argument,  nullptr, 'a' },
+        { "jobs",       required_argument,  nullptr, 'j' },
+        { "help",       no_argument,        nullptr, 'h' },
+        { nullptr,      0,                  nullptr, 0 }
+    };
+
+    Options opts;
+
+    int c;
+    while ((c=getopt_long(argc, argv, "v:d:f:w:q:o:m:s:F:a:j:h", longopts, nullptr))!=-1) {
+        switch (c) {
+        case 'v':
+            opts.params[OPAL_PARAM_NUMVOICES]=atoi(optarg);
+            break;
+        case 'd':
+            opts.params[OPAL_PARAM_DEPTH]=parse_number(optarg);
+            break;
+        case 'f':
+            opts.params[OPAL_PARAM_FREQUENCY]=parse_number(optarg);
+            break;
+        case 'w':
+            opts.params[OPAL_PARAM_WIDTH]=parse_number(optarg);
+            break;
+        case 'q':
+            opts.params[OPAL_PARAM_INTERPOLATION]=atoi(optarg);
+            break;
+        case 'o':
+            opts.params[OPAL_PARAM_OVERSAMPLING]=atoi(optarg);
+            break;
+        case 'm':
+            if (!strcmp(optarg, "half"))
+                opts.storage=OPAL_STORAGE_HALF;
+            else if (strcmp(optarg, "float")) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            opts.seed=strtoul(optarg, nullptr, 0);
+            break;
+        case 'F':
+            for (int f=0;f<NUM_SAMPLE_TYPES;f++)
+                if (!strcmp(optarg, SAMPLE_NAMES[f]))
+                    opts.format=f;
+            if (opts.format<0) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'a':
+            opts.automations.push_back(parse_automation(optarg));
+            break;
+        case 'j':
+            opts.jobs=atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    const float* p=opts.params;
+    const int oversampling=(int) p[OPAL_PARAM_OVERSAMPLING];
+
+    const bool valid=optind + 2==argc &&
+                     p[OPAL_PARAM_NUMVOICES]>=1 && p[OPAL_PARAM_NUMVOICES]<=128 &&
+                     p[OPAL_PARAM_INTERPOLATION]>=0 && p[OPAL_PARAM_INTERPOLATION]<=4 &&
+                     (oversampling==1 || oversampling==2 || oversampling==4);
+
+    if (!valid) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    opts.input=argv[optind];
+    opts.output=argv[optind + 1];
+
+    return opts;
+}
+
+
+[[noreturn]] void fail(const char* path, const char* message)
+{
+    fprintf(stderr, "%s: %s\n", path, message);
+    exit(EXIT_FAILURE);
+}
+
+
+// a whole file mapped for reading, or created at its size for writing
+class MappedFile {
+public:
+    explicit MappedFile(const char* path)
+    {
+        fd=open(path, O_RDONLY);
+        if (fd<0)
+            fail(path, strerror(errno));
+
+        struct stat st;
+        if (fstat(fd, &st)<0)
+            fail(path, strerror(errno));
+        if (st.st_size<12)
+            fail(path, "not a WAV file");
+
+        size=st.st_size;
+        map(path, PROT_READ, MAP_PRIVATE);
+
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+
+    MappedFile(const char* path, uint64_t size):
+        size(size)
+    {
+        fd=open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd<0)
+            fail(path, strerror(errno));
+
+        // allocated up front where possible, as a full disk would only show
+        // as a fault on writing into the mapping
+#ifdef __linux__
+        const int error=posix_fallocate(fd, 0, size);
+        if (error)
+            fail(path, strerror(error));
+#else
+        if (ftruncate(fd, size)<0)
+            fail(path, strerror(errno));
+#endif
+
+        map(path, PROT_READ | PROT_WRITE, MAP_SHARED);
+    }
+
+    ~MappedFile()
+    {
+        munmap(data, size);
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&)=delete;
+    MappedFile& operator=(const MappedFile&)=delete;
+
+    void release(uint64_t begin, uint64_t end)
+    {
+        const uint64_t page=sysconf(_SC_PAGESIZE);
+
+        begin&=-page;
+        end&=-page;
+
+        if (end>begin)
+            madvise(data + begin, end - begin, MADV_DONTNEED);
+    }
+
+    uint8_t*    data;
+    uint64_t    size;
+
+private:
+    int         fd;
+
+    void map(const char* path, int prot, int flags)
+    {
+        void* p=mmap(nullptr, size, prot, flags, fd, 0);
+        if (p==MAP_FAILED)
+            fail(path, strerror(errno));
+
+        data=(uint8_t*) p;
+    }
+};
+
+
+uint16_t get16(const uint8_t* p)
+{
+    return p[0] | p[1]<<8;
+}
+
+uint32_t get32(const uint8_t* p)
+{
+    return get16(p) | (uint32_t) get16(p + 2)<<16;
+}
+
+uint64_t get64(const uint8_t* p)
+{
+    return get32(p) | (uint64_t) get32(p + 4)<<32;
+}
+
+void put16(uint8_t* p, uint16_t x)
+{
+    p[0]=x;
+    p[1]=x>>8;
+}
+
+void put32(uint8_t* p, uint32_t x)
+{
+    put16(p, x);
+    put16(p + 2, x>>16);
+}
+
+void put64(uint8_t* p, uint64_t x)
+{
+    put32(p, x);
+    put32(p + 4, x>>32);
+}
+
+
+struct WavFormat {
+    int         channels;
+    uint32_t    samplerate;
+    sample_t    type;
+
+    // speaker positions, or zero if not given
+    uint32_t    channelmask;
+};
+
+
+// PCM or float WAV, also RF64 and BW64 with their ds64 chunk
+struct WavReader {
+    WavFormat       format;
+    const uint8_t*  samples=nullptr;
+    uint64_t        frames=0;
+
+    WavReader(const MappedFile& file, const char* path)
+    {
+        const uint8_t* p=file.data;
+
+        const bool rf64=!memcmp(p, "RF64", 4) || !memcmp(p, "BW64", 4);
+        if ((memcmp(p, "RIFF", 4) && !rf64) || memcmp(p + 8, "WAVE", 4))
+            fail(path, "not a WAV file");
+
+        uint64_t datasize64=0;
+        int tag=0, bits=0, align=0;
+
+        for (uint64_t offset=12;offset + 8<=file.size;) {
+            const uint8_t* chunk=p + offset;
+            const uint64_t body=offset + 8;
+            uint64_t length=get32(chunk + 4);
+
+            if (!memcmp(chunk, "ds64", 4) && length>=28 && body + 28<=file.size)
+                datasize64=get64(chunk + 16);
+            else if (!memcmp(chunk, "fmt ", 4) && length>=16 && body + 16<=file.size) {
+                tag=get16(chunk + 8);
+                format.channels=get16(chunk + 10);
+                format.samplerate=get32(chunk + 12);
+                align=get16(chunk + 20);
+                bits=get16(chunk + 22);
+                format.channelmask=0;
+
+                if (tag==0xfffe && length>=40 && body + 40<=file.size) {
+                    format.channelmask=get32(chunk + 28);
+                    tag=get16(chunk + 32);
+                }
+            }
+            else if (!memcmp(chunk, "data", 4)) {
+                if (rf64 && length==0xffffffff)
+                    length=datasize64;
+
+                samples=chunk + 8;
+                frames=std::min(length, file.size - body) / (align>0 ? align : 1);
+                break;
+            }
+
+            offset=body + length + (length & 1);
+        }
+
+        if (tag==1 && bits==16)
+            format.type=SAMPLE_INT16;
+        else if (tag==1 && bits==24)
+            format.type=SAMPLE_INT24;
+        else if (tag==1 && bits==32)
+            format.type=SAMPLE_INT32;
+        else if (tag==3 && bits==32)
+            format.type=SAMPLE_FLOAT32;
+        else
+            fail(path, "unsupported sample format, only 16, 24 or 32 bit integers and 32 bit floats");
+
+        if (!samples)
+            fail(path, "no data chunk");
+        if (align!=format.channels * SAMPLE_BYTES[format.type] || format.samplerate==0)
+            fail(path, "inconsistent format chunk");
+        if (format.channels<1 || format.channels>8)
+            fail(path, "only 1 to 8 channels are supported");
+    }
+};
+
+
+// the JUNK chunk becomes a ds64 chunk when the data outgrows RIFF
+struct WavWriter {
+    static constexpr int HEADER=12 + 36 + 48 + 8;
+
+    WavFormat   format;
+    uint64_t    frames;
+    uint64_t    datasize;
+
+    WavWriter(const WavFormat& format, uint64_t frames):
+        format(format),
+        frames(frames),
+        datasize(frames * format.channels * SAMPLE_BYTES[format.type])
+    {
+    }
+
+    // including a pad byte if the data has an odd length
+    uint64_t size() const
+    {
+        return HEADER + datasize + (datasize & 1);
+    }
+
+    void write(uint8_t* p) const
+    {
+        const bool rf64=size() - 8>0xffffffff;
+        const int bytes=SAMPLE_BYTES[format.type];
+        const int tag=format.type==SAMPLE_FLOAT32 ? 3 : 1;
+
+        memcpy(p, rf64 ? "RF64" : "RIFF", 4);
+        put32(p + 4, rf64 ? 0xffffffff : size() - 8);
+        memcpy(p + 8, "WAVE", 4);
+
+        memcpy(p + 12, rf64 ? "ds64" : "JUNK", 4);
+        put32(p + 16, 28);
+        memset(p + 20, 0, 28);
+        if (rf64) {
+            put64(p + 20, size() - 8);
+            put64(p + 28, datasize);
+            put64(p + 36, frames);
+        }
+
+        // a plain format chunk is followed by a JUNK chunk of the same size
+        // as the extension, so that the data starts at the same place
+        const bool extensible=format.channels>2 || bytes>2;
+
+        memcpy(p + 48, "fmt ", 4);
+        put32(p + 52, extensible ? 40 : 16);
+        put16(p + 56, extensible ? 0xfffe : tag);
+        put16(p + 58, format.channels);
+        put32(p + 60, format.samplerate);
+        put32(p + 64, format.samplerate * format.channels * bytes);
+        put16(p + 68, format.channels * bytes);
+        put16(p + 70, 8 * bytes);
+
+        if (extensible) {
+            static const uint8_t guid[14]={ 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 };
+
+            put16(p + 72, 22);
+            put16(p + 74, 8 * bytes);
+            put32(p + 76, format.channelmask);
+            put16(p + 80, tag);
+            memcpy(p + 82, guid, 14);
+        }
+        else {
+            memcpy(p + 72, "JUNK", 4);
+            put32(p + 76, 16);
+            memset(p + 80, 0, 16);
+        }
+
+        memcpy(p + 96, "data", 4);
+        put32(p + 100, rf64 ? 0xffffffff : datasize);
+
+        if (datasize & 1)
+            p[HEADER + datasize]=0;
+    }
+};
+
+
+// clamped before it is scaled and converted, as converting a NaN or a
+// float out of range to an integer is undefined; NaNs become silence
+float quantize(float x, float scale, float max)
+{
+    x=x>=-1.0f ? (x<=1.0f ? x : 1.0f) : (x<-1.0f ? -1.0f : 0.0f);
+
+    const float y=rintf(x * scale);
+    return y>max ? max : y;
+}
+
+
+struct Int16 {
+    static constexpr int BYTES=2;
+
+    static float load(const uint8_t* p)
+    {
+        return (int16_t) get16(p) * (1.0f / 32768);
+    }
+
+    static void store(uint8_t* p, float x)
+    {
+        put16(p, (int16_t) quantize(x, 32768.0f, 32767.0f));
+    }
+};
+
+
+struct Int24 {
+    static constexpr int BYTES=3;
+
+    static float load(const uint8_t* p)
+    {
+        return (int32_t) ((uint32_t) (p[0] | p[1]<<8 | p[2]<<16) << 8) * (1.0f / 2147483648.0f);
+    }
+
+    static void store(uint8_t* p, float x)
+    {
+        const int32_t y=(int32_t) quantize(x, 8388608.0f, 8388607.0f);
+
+        p[0]=y;
+        p[1]=y>>8;
+        p[2]=y>>16;
+    }
+};
+
+
+struct Int32 {
+    static constexpr int BYTES=4;
+
+    static float load(const uint8_t* p)
+    {
+        return (int32_t) get32(p) * (1.0f / 2147483648.0f);
+    }
+
+    // the largest float below 2^31 is 2^31-128
+    static void store(uint8_t* p, float x)
+    {
+        put32(p, (int32_t) quantize(x, 2147483648.0f, 2147483520.0f));
+    }
+};
+
+
+struct Float32 {
+    static constexpr int BYTES=4;
+
+    static float load(const uint8_t* p)
+    {
+        const uint32_t bits=get32(p);
+
+        float x;
+        memcpy(&x, &bits, 4);
+        return x;
+    }
+
+    static void store(uint8_t* p, float x)
+    {
+        uint32_t bits;
+        memcpy(&bits, &x, 4);
+
+        put32(p, bits);
+    }
+};
+
+
+template<typename S>
+void deinterleave(const uint8_t* p, int channels, uint32_t frames, float* const* outputs)
+{
+    for (uint32_t i=0;i<frames;i++)
+        for (int c=0;c<channels;c++, p+=S::BYTES)
+            outputs[c][i]=S::load(p);
+}
+
+
+template<typename S>
+void interleave(const float* const* inputs, int channels, uint32_t frames, uint8_t* p)
+{
+    for (uint32_t i=0;i<frames;i++)
+        for (int c=0;c<channels;c++, p+=S::BYTES)
+            S::store(p, inputs[c][i]);
+}
+
+
+void load(sample_t type, const uint8_t* p, int channels, uint32_t frames, float* const* outputs)
+{
+    switch (type) {
+    case SAMPLE_INT16:
+        deinterleave<Int16>(p, channels, frames, outputs);
+        break;
+    case SAMPLE_INT24:
+        deinterleave<Int24>(p, channels, frames, outputs);
+        break;
+    case SAMPLE_INT32:
+        deinterleave<Int32>(p, channels, frames, outputs);
+        break;
+    default:
+        deinterleave<Float32>(p, channels, frames, outputs);
+        break;
+    }
+}
+
+
+void store(sample_t type, const float* const* inputs, int channels, uint32_t frames, uint8_t* p)
+{
+    switch (type) {
+    case SAMPLE_INT16:
+        interleave<Int16>(inputs, channels, frames, p);
+        break;
+    case SAMPLE_INT24:
+        interleave<Int24>(inputs, channels, frames, p);
+        break;
+    case SAMPLE_INT32:
+        interleave<Int32>(inputs, channels, frames, p);
+        break;
+    default:
+        interleave<Float32>(inputs, channels, frames, p);
+        break;
+    }
+}
+
+
+// frames converted at a time, and processed at a time while automated
+constexpr uint32_t BLOCK=1<<16;
+constexpr uint32_t STEP=256;
+
+
+struct Render {
+    const Options&      opts;
+    const WavReader&    reader;
+    const WavFormat&    format;
+
+    MappedFile&         infile;
+    MappedFile&         outfile;
+
+    // the first latency frames of the output are dropped, and as many
+    // frames of silence are appended to the input to flush the filters
+    uint64_t            latency;
+    uint64_t            length;
+};
+
+
+opal_chorus* create(const Options& opts, const WavFormat& format)
+{
+    opal_chorus* opal=opal_create_ex(format.samplerate, opts.seed, format.channels, opts.storage);
+    if (!opal)
+        fail(opts.input, "cannot create the chorus");
+
+    for (int p=0;p<OPAL_NUM_PARAMS;p++)
+        opal_set_parameter(opal, (opal_param_t) p, opts.params[p]);
+
+    opal_reset(opal);
+
+    return opal;
+}
+
+
+// one chunk on a chorus of its own, from the preroll before it in whole
+// blocks, so that it matches a render in one piece
+void render(const Render& r, uint64_t begin, uint64_t end)
+{
+    const int channels=r.format.channels;
+    const int in_bytes=channels * SAMPLE_BYTES[r.reader.format.type];
+    const int out_bytes=channels * SAMPLE_BYTES[r.format.type];
+
+    opal_chorus* opal=create(r.opts, r.format);
+
+    const uint64_t preroll=(opal_preroll(opal) + BLOCK - 1) / BLOCK * BLOCK;
+    const uint64_t start=begin>preroll ? begin - preroll : 0;
+
+    opal_seek(opal, start);
+
+    std::vector<float> scratch((size_t) channels * BLOCK);
+    float* buffers[8];
+    for (int c=0;c<channels;c++)
+        buffers[c]=scratch.data() + (size_t) c * BLOCK;
+
+    for (uint64_t pos=start;pos<end;pos+=BLOCK) {
+        const uint32_t frames=(uint32_t) std::min<uint64_t>(BLOCK, end - pos);
+
+        // input frames of this block, the rest is silence
+        const uint32_t valid=pos<r.reader.frames ? (uint32_t) std::min<uint64_t>(frames, r.reader.frames - pos) : 0;
+
+        if (valid>0)
+            load(r.reader.format.type, r.reader.samples + pos * in_bytes, channels, valid, buffers);
+        for (int c=0;c<channels;c++)
+            std::fill(buffers[c] + valid, buffers[c] + frames, 0.0f);
+
+        if (r.opts.automations.empty())
+            opal_process(opal, buffers, buffers, frames);
+        else {
+            for (uint32_t i=0;i<frames;i+=STEP) {
+                for (const Automation& a: r.opts.automations)
+                    opal_set_parameter(opal, a.param, a.at((double) (pos + i) / r.format.samplerate));
+
+                float* chunk[8];
+                for (int c=0;c<channels;c++)
+                    chunk[c]=buffers[c] + i;
+
+                opal_process(opal, chunk, chunk, std::min(STEP, frames - i));
+            }
+        }
+
+        // the output frames of this block, after the preroll and the latency
+        const uint64_t first=std::max(std::max(pos, begin), r.latency);
+        const uint64_t last=pos + frames;
+
+        if (last>first) {
+            float* outputs[8];
+            for (int c=0;c<channels;c++)
+                outputs[c]=buffers[c] + (first - pos);
+
+            store(r.format.type, outputs, channels, (uint32_t) (last - first), r.outfile.data + WavWriter::HEADER + (first - r.latency) * out_bytes);
+        }
+
+        const uint64_t in_offset=r.reader.samples - r.infile.data;
+
+        r.infile.release(in_offset + std::min(pos, r.reader.frames) * in_bytes, in_offset + std::min(last, r.reader.frames) * in_bytes);
+        r.outfile.release(WavWriter::HEADER + (first - r.latency) * out_bytes, WavWriter::HEADER + (last - std::min(last, r.latency)) * out_bytes);
+    }
+
+    opal_destroy(opal);
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    Options opts=parse_options(argc, argv);
+
+    // writing the output truncates it, which must not hit the input
+    struct stat in_st, out_st;
+    if (stat(opts.input, &in_st)==0 && stat(opts.output, &out_st)==0 && in_st.st_dev==out_st.st_dev && in_st.st_ino==out_st.st_ino)
+        fail(opts.output, "is the input");
+
+    MappedFile infile(opts.input);
+    const WavReader reader(infile, opts.input);
+
+    WavFormat format=reader.format;
+    if (opts.format>=0)
+        format.type=(sample_t) opts.format;
+
+    const WavWriter writer(format, reader.frames);
+
+    MappedFile outfile(opts.output, writer.size());
+    writer.write(outfile.data);
+
+    opal_chorus* opal=create(opts, format);
+    const uint64_t latency=opal_latency(opal);
+    opal_destroy(opal);
+
+    const Render r={ opts, reader, format, infile, outfile, latency, reader.frames + latency };
+
+    // a chunk can only be sought to at a constant frequency
+    for (const Automation& a: opts.automations) {
+        if (a.param==OPAL_PARAM_FREQUENCY && opts.jobs!=1) {
+            fprintf(stderr, "%s: rendering in one piece, as the frequency is automated\n", opts.output);
+            opts.jobs=1;
+        }
+    }
+
+    if (opts.jobs==0)
+        opts.jobs=std::max(1u, std::thread::hardware_concurrency());
+
+    const uint64_t blocks=(r.length + BLOCK - 1) / BLOCK;
+    const int jobs=(int) std::min<uint64_t>(opts.jobs, std::max<uint64_t>(blocks, 1));
+
+    const auto start=std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int j=0;j<jobs;j++) {
+        const uint64_t begin=std::min(blocks * j / jobs * BLOCK, r.length);
+        const uint64_t end=std::min(blocks * (j+1) / jobs * BLOCK, r.length);
+
+        threads.emplace_back(render, std::cref(r), begin, end);
+    }
+
+    for (std::thread& thread: threads)
+        thread.join();
+
+    const std::chrono::duration<double> elapsed=std::chrono::steady_clock::now() - start;
+
+    const double seconds=(double) reader.frames / format.samplerate;
+    const double megabytes=(double) reader.frames * format.channels * (SAMPLE_BYTES[reader.format.type] + SAMPLE_BYTES[format.type]) / 1e6;
+
+    printf("%s: %llu frames of %d channel(s) at %u Hz, %s to %s, %.1f s in %.2f s with %d job(s), %.0fx real time, %.0f MB/s, kernels %s\n",
+           opts.output, (unsigned long long) reader.frames, format.channels, format.samplerate,
+           SAMPLE_NAMES[reader.format.type], SAMPLE_NAMES[format.type], seconds, elapsed.count(), jobs,
+           seconds / elapsed.count(), megabytes / elapsed.count(), opal_kernels());
+
+    return 0;
+}
@@ -0,0 +1,644 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#ifndef INCLUDE_STUDIOGEMS_OPALSIMD_H
+#define INCLUDE_STUDIOGEMS_OPALSIMD_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifndef OPAL_KERNEL_VARIANT
+#define OPAL_KERNEL_VARIANT baseline
+#endif
+
+namespace StudioGemsDSP {
+
+// per variant, so that variants never share an inline function
+namespace OPAL_KERNEL_VARIANT {
+
+// 8-lane vectors on AVX2, SSE2 or plain arrays; masks have all bits set
+
+struct vint8;
+
+struct vfloat8 {
+#if defined(__AVX2__)
+    __m256  v;
+#elif defined(__SSE2__)
+    __m128  lo, hi;
+#else
+    float   f[8];
+#endif
+
+    static vfloat8 load(const float* p);
+    static vfloat8 broadcast(float x);
+    static vfloat8 zero() { return broadcast(0.0f); }
+
+    void store(float* p) const;
+};
+
+
+struct vint8 {
+#if defined(__AVX2__)
+    __m256i v;
+#elif defined(__SSE2__)
+    __m128i lo, hi;
+#else
+    int32_t i[8];
+#endif
+
+    static vint8 load(const int32_t* p);
+    static vint8 broadcast(int32_t x);
+
+    void store(int32_t* p) const;
+};
+
+
+#if defined(__AVX2__)
+
+inline vfloat8 vfloat8::load(const float* p)        { return { _mm256_loadu_ps(p) }; }
+inline vfloat8 vfloat8::broadcast(float x)          { return { _mm256_set1_ps(x) }; }
+inline void vfloat8::store(float* p) const          { _mm256_storeu_ps(p, v); }
+
+inline vint8 vint8::load(const int32_t* p)          { return { _mm256_loadu_si256((const __m256i*) p) }; }
+inline vint8 vint8::broadcast(int32_t x)            { return { _mm256_set1_epi32(x) }; }
+inline void vint8::store(int32_t* p) const          { _mm256_storeu_si256((__m256i*) p, v); }
+
+inline vfloat8 operator+(vfloat8 a, vfloat8 b)      { return { _mm256_add_ps(a.v, b.v) }; }
+inline vfloat8 operator-(vfloat8 a, vfloat8 b)      { return { _mm256_sub_ps(a.v, b.v) }; }
+inline vfloat8 operator*(vfloat8 a, vfloat8 b)      { return { _mm256_mul_ps(a.v, b.v) }; }
+inline vfloat8 operator/(vfloat8 a, vfloat8 b)      { return { _mm256_div_ps(a.v, b.v) }; }
+inline vfloat8 operator&(vfloat8 a, vfloat8 b)      { return { _mm256_and_ps(a.v, b.v) }; }
+inline vfloat8 operator>=(vfloat8 a, vfloat8 b)     { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+
+inline int movemask(vfloat8 m)                      { return _mm256_movemask_ps(m.v); }
+
+inline float hsum(vfloat8 a)
+{
+    __m128 s=_mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+    s=_mm_add_ps(s, _mm_movehl_ps(s, s));
+    s=_mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+inline vint8 operator+(vint8 a, vint8 b)            { return { _mm256_add_epi32(a.v, b.v) }; }
+inline vint8 operator-(vint8 a, vint8 b)            { return { _mm256_sub_epi32(a.v, b.v) }; }
+inline vint8 operator&(vint8 a, vint8 b)            { return { _mm256_and_si256(a.v, b.v) }; }
+inline vint8 operator^(vint8 a, vint8 b)            { return { _mm256_xor_si256(a.v, b.v) }; }
+inline vint8 operator==(vint8 a, vint8 b)           { return { _mm256_cmpeq_epi32(a.v, b.v) }; }
+
+// logical shifts
+template<int n> inline vint8 shl(vint8 a)           { return { _mm256_slli_epi32(a.v, n) }; }
+template<int n> inline vint8 shr(vint8 a)           { return { _mm256_srli_epi32(a.v, n) }; }
+
+inline vfloat8 as_float(vint8 a)                    { return { _mm256_castsi256_ps(a.v) }; }
+inline vint8 as_int(vfloat8 a)                      { return { _mm256_castps_si256(a.v) }; }
+
+inline vfloat8 select(vfloat8 m, vfloat8 a, vfloat8 b)  { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+
+// truncating conversion, only used on non-negative values
+inline vint8 to_int(vfloat8 a)                      { return { _mm256_cvttps_epi32(a.v) }; }
+inline vfloat8 to_float(vint8 a)                    { return { _mm256_cvtepi32_ps(a.v) }; }
+
+
+inline vfloat8 gather(const float* base, vint8 idx) { return { _mm256_i32gather_ps(base, idx.v, 4) }; }
+
+#elif defined(__SSE2__)
+
+inline vfloat8 vfloat8::load(const float* p)        { return { _mm_loadu_ps(p), _mm_loadu_ps(p+4) }; }
+inline vfloat8 vfloat8::broadcast(float x)          { return { _mm_set1_ps(x), _mm_set1_ps(x) }; }
+inline void vfloat8::store(float* p) const          { _mm_storeu_ps(p, lo); _mm_storeu_ps(p+4, hi); }
+
+inline vint8 vint8::load(const int32_t* p)          { return { _mm_loadu_si128((const __m128i*) p), _mm_loadu_si128((const __m128i*) (p+4)) }; }
+inline vint8 vint8::broadcast(int32_t x)            { return { _mm_set1_epi32(x), _mm_set1_epi32(x) }; }
+inline void vint8::store(int32_t* p) const          { _mm_storeu_si128((__m128i*) p, lo); _mm_storeu_si128((__m128i*) (p+4), hi); }
+
+inline vfloat8 operator+(vfloat8 a, vfloat8 b)      { return { _mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi) }; }
+inline vfloat8 operator-(vfloat8 a, vfloat8 b)      { return { _mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi) }; }
+inline vfloat8 operator*(vfloat8 a, vfloat8 b)      { return { _mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi) }; }
+inline vfloat8 operator/(vfloat8 a, vfloat8 b)      { return { _mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi) }; }
+inline vfloat8 operator&(vfloat8 a, vfloat8 b)      { return { _mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi) }; }
+inline vfloat8 operator>=(vfloat8 a, vfloat8 b)     { return { _mm_cmpge_ps(a.lo, b.lo), _mm_cmpge_ps(a.hi, b.hi) }; }
+
+inline int movemask(vfloat8 m)                      { return _mm_movemask_ps(m.lo) | (_mm_movemask_ps(m.hi)<<4); }
+
+inline float hsum(vfloat8 a)
+{
+    __m128 s=_mm_add_ps(a.lo, a.hi);
+    s=_mm_add_ps(s, _mm_movehl_ps(s, s));
+    s=_mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+inline vint8 operator+(vint8 a, vint8 b)            { return { _mm_add_epi32(a.lo, b.lo), _mm_add_epi32(a.hi, b.hi) }; }
+inline vint8 operator-(vint8 a, vint8 b)            { return { _mm_sub_epi32(a.lo, b.lo), _mm_sub_epi32(a.hi, b.hi) }; }
+inline vint8 operator&(vint8 a, vint8 b)            { return { _mm_and_si128(a.lo, b.lo), _mm_and_si128(a.hi, b.hi) }; }
+inline vint8 operator^(vint8 a, vint8 b)            { return { _mm_xor_si128(a.lo, b.lo), _mm_xor_si128(a.hi, b.hi) }; }
+inline vint8 operator==(vint8 a, vint8 b)           { return { _mm_cmpeq_epi32(a.lo, b.lo), _mm_cmpeq_epi32(a.hi, b.hi) }; }
+
+template<int n> inline vint8 shl(vint8 a)           { return { _mm_slli_epi32(a.lo, n), _mm_slli_epi32(a.hi, n) }; }
+template<int n> inline vint8 shr(vint8 a)           { return { _mm_srli_epi32(a.lo, n), _mm_srli_epi32(a.hi, n) }; }
+
+inline vfloat8 as_float(vint8 a)                    { return { _mm_castsi128_ps(a.lo), _mm_castsi128_ps(a.hi) }; }
+inline vint8 as_int(vfloat8 a)                      { return { _mm_castps_si128(a.lo), _mm_castps_si128(a.hi) }; }
+
+inline vfloat8 select(vfloat8 m, vfloat8 a, vfloat8 b)
+{
+    return {
+        _mm_or_ps(_mm_and_ps(m.lo, a.lo), _mm_andnot_ps(m.lo, b.lo)),
+        _mm_or_ps(_mm_and_ps(m.hi, a.hi), _mm_andnot_ps(m.hi, b.hi))
+    };
+}
+
+inline vint8 to_int(vfloat8 a)                      { return { _mm_cvttps_epi32(a.lo), _mm_cvttps_epi32(a.hi) }; }
+inline vfloat8 to_float(vint8 a)                    { return { _mm_cvtepi32_ps(a.lo), _mm_cvtepi32_ps(a.hi) }; }
+
+// SSE2 has no gather instruction, so fetch the lanes one by one
+inline vfloat8 gather(const float* base, vint8 idx)
+{
+    alignas(16) int32_t i[8];
+    idx.store(i);
+
+    return {
+        _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]),
+        _mm_setr_ps(base[i[4]], base[i[5]], base[i[6]], base[i[7]])
+    };
+}
+
+#else
+
+inline vfloat8 vfloat8::load(const float* p)
+{
+    vfloat8 r;
+    for (int k=0;k<8;k++) r.f[k]=p[k];
+    return r;
+}
+
+inline vfloat8 vfloat8::broadcast(float x)
+{
+    vfloat8 r;
+    for (int k=0;k<8;k++) r.f[k]=x;
+    return r;
+}
+
+inline void vfloat8::store(float* p) const
+{
+    for (int k=0;k<8;k++) p[k]=f[k];
+}
+
+inline vint8 vint8::load(const int32_t* p)
+{
+    vint8 r;
+    for (int k=0;k<8;k++) r.i[k]=p[k];
+    return r;
+}
+
+inline vint8 vint8::broadcast(int32_t x)
+{
+    vint8 r;
+    for (int k=0;k<8;k++) r.i[k]=x;
+    return r;
+}
+
+inline void vint8::store(int32_t* p) const
+{
+    for (int k=0;k<8;k++) p[k]=i[k];
+}
+
+#define OPAL_SIMD_LANEWISE(type, op, expr) \
+    inline type op(type a, type b) { type r; for (int k=0;k<8;k++) expr; return r; }
+
+OPAL_SIMD_LANEWISE(vfloat8, operator+, r.f[k]=a.f[k]+b.f[k])
+OPAL_SIMD_LANEWISE(vfloat8, operator-, r.f[k]=a.f[k]-b.f[k])
+OPAL_SIMD_LANEWISE(vfloat8, operator*, r.f[k]=a.f[k]*b.f[k])
+OPAL_SIMD_LANEWISE(vfloat8, operator/, r.f[k]=a.f[k]/b.f[k])
+OPAL_SIMD_LANEWISE(vint8, operator+, r.i[k]=a.i[k]+b.i[k])
+OPAL_SIMD_LANEWISE(vint8, operator-, r.i[k]=a.i[k]-b.i[k])
+OPAL_SIMD_LANEWISE(vint8, operator&, r.i[k]=a.i[k]&b.i[k])
+OPAL_SIMD_LANEWISE(vint8, operator^, r.i[k]=a.i[k]^b.i[k])
+OPAL_SIMD_LANEWISE(vint8, operator==, r.i[k]=a.i[k]==b.i[k] ? -1 : 0)
+
+#undef OPAL_SIMD_LANEWISE
+
+template<int n> inline vint8 shl(vint8 a)
+{
+    vint8 r;
+    for (int k=0;k<8;k++) r.i[k]=(int32_t) ((uint32_t) a.i[k] << n);
+    return r;
+}
+
+template<int n> inline vint8 shr(vint8 a)
+{
+    vint8 r;
+    for (int k=0;k<8;k++) r.i[k]=(int32_t) ((uint32_t) a.i[k] >> n);
+    return r;
+}
+
+inline vfloat8 as_float(vint8 a)
+{
+    vfloat8 r;
+    memcpy(r.f, a.i, sizeof(r.f));
+    return r;
+}
+
+inline vint8 as_int(vfloat8 a)
+{
+    vint8 r;
+    memcpy(r.i, a.f, sizeof(r.i));
+    return r;
+}
+
+inline vfloat8 operator&(vfloat8 a, vfloat8 b)
+{
+    return as_float(as_int(a) & as_int(b));
+}
+
+inline vfloat8 select(vfloat8 m, vfloat8 a, vfloat8 b)
+{
+    vfloat8 r;
+    for (int k=0;k<8;k++) r.f[k]=std::signbit(m.f[k]) ? a.f[k] : b.f[k];
+    return r;
+}
+
+inline vfloat8 operator>=(vfloat8 a, vfloat8 b)
+{
+    vfloat8 r;
+    for (int k=0;k<8;k++) {
+        uint32_t m=a.f[k]>=b.f[k] ? ~0u : 0u;
+        memcpy(&r.f[k], &m, 4);
+    }
+    return r;
+}
+
+inline int movemask(vfloat8 m)
+{
+    int bits=0;
+    for (int k=0;k<8;k++)
+        if (std::signbit(m.f[k]))
+            bits|=1<<k;
+    return bits;
+}
+
+inline float hsum(vfloat8 a)
+{
+    return ((a.f[0]+a.f[4]) + (a.f[2]+a.f[6])) + ((a.f[1]+a.f[5]) + (a.f[3]+a.f[7]));
+}
+
+inline vint8 to_int(vfloat8 a)
+{
+    vint8 r;
+    for (int k=0;k<8;k++) r.i[k]=(int32_t) a.f[k];
+    return r;
+}
+
+inline vfloat8 to_float(vint8 a)
+{
+    vfloat8 r;
+    for (int k=0;k<8;k++) r.f[k]=(float) a.i[k];
+    return r;
+}
+
+inline vfloat8 gather(const float* base, vint8 idx)
+{
+    vfloat8 r;
+    for (int k=0;k<8;k++) r.f[k]=base[idx.i[k]];
+    return r;
+}
+
+#endif
+
+
+inline vint8 select(vint8 m, vint8 a, vint8 b)
+{
+    return as_int(select(as_float(m), as_float(a), as_float(b)));
+}
+
+
+// lane mask with the lanes set whose bit is set in bits
+inline vint8 lanes_from_bits(int bits)
+{
+    static const int32_t weights[8]={ 1, 2, 4, 8, 16, 32, 64, 128 };
+    const vint8 w=vint8::load(weights);
+
+    return (vint8::broadcast(bits) & w) == w;
+}
+
+
+// lane mask with the first n lanes set
+inline vfloat8 first_lanes(int n)
+{
+    alignas(32) static const uint32_t bits[16]={
+        ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u, ~0u,
+        0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u
+    };
+
+    return vfloat8::load((const float*) (bits + 8 - n));
+}
+
+
+// the even lanes of a and the odd lanes of b
+inline vfloat8 interleave(vfloat8 a, vfloat8 b)
+{
+#if defined(__AVX2__)
+    return { _mm256_blend_ps(a.v, b.v, 0xaa) };
+#else
+    return select(as_float(lanes_from_bits(0xaa)), b, a);
+#endif
+}
+
+
+// stores a[0], b[0], a[1], b[1], ..., a[7], b[7] to p[0..15]
+inline void store_zipped(float* p, vfloat8 a, vfloat8 b)
+{
+#if defined(__AVX2__)
+    const __m256 lo=_mm256_unpacklo_ps(a.v, b.v);
+    const __m256 hi=_mm256_unpackhi_ps(a.v, b.v);
+    _mm256_storeu_ps(p, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(p+8, _mm256_permute2f128_ps(lo, hi, 0x31));
+#elif defined(__SSE2__)
+    _mm_storeu_ps(p, _mm_unpacklo_ps(a.lo, b.lo));
+    _mm_storeu_ps(p+4, _mm_unpackhi_ps(a.lo, b.lo));
+    _mm_storeu_ps(p+8, _mm_unpacklo_ps(a.hi, b.hi));
+    _mm_storeu_ps(p+12, _mm_unpackhi_ps(a.hi, b.hi));
+#else
+    for (int k=0;k<8;k++) {
+        p[2*k]=a.f[k];
+        p[2*k+1]=b.f[k];
+    }
+#endif
+}
+
+
+// loads p[0..15] and splits it into the even and the odd elements
+inline void load_unzipped(const float* p, vfloat8& even, vfloat8& odd)
+{
+#if defined(__AVX2__)
+    const __m256 x=_mm256_loadu_ps(p);
+    const __m256 y=_mm256_loadu_ps(p+8);
+    even.v=_mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(x, y, 0x88)), 0xd8));
+    odd.v=_mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(x, y, 0xdd)), 0xd8));
+#elif defined(__SSE2__)
+    const __m128 x0=_mm_loadu_ps(p), x1=_mm_loadu_ps(p+4), x2=_mm_loadu_ps(p+8), x3=_mm_loadu_ps(p+12);
+    even.lo=_mm_shuffle_ps(x0, x1, 0x88);
+    even.hi=_mm_shuffle_ps(x2, x3, 0x88);
+    odd.lo=_mm_shuffle_ps(x0, x1, 0xdd);
+    odd.hi=_mm_shuffle_ps(x2, x3, 0xdd);
+#else
+    for (int k=0;k<8;k++) {
+        even.f[k]=p[2*k];
+        odd.f[k]=p[2*k+1];
+    }
+#endif
+}
+
+
+// load of the first n lanes only; the other lanes are zero or hold the
+// values that follow in memory
+template<int n>
+inline vfloat8 load_first(const float* p)
+{
+#if defined(__AVX2__)
+    if (n>4)
+        return vfloat8::load(p);
+
+    const __m128 lo=n>2 ? _mm_loadu_ps(p) : n>1 ? _mm_castpd_ps(_mm_load_sd((const double*) p)) : _mm_load_ss(p);
+    return { _mm256_insertf128_ps(_mm256_setzero_ps(), lo, 0) };
+#elif defined(__SSE2__)
+    return {
+        n>2 ? _mm_loadu_ps(p) : n>1 ? _mm_castpd_ps(_mm_load_sd((const double*) p)) : _mm_load_ss(p),
+        n>4 ? _mm_loadu_ps(p+4) : _mm_setzero_ps()
+    };
+#else
+    vfloat8 r=vfloat8::zero();
+    for (int k=0;k<n;k++) r.f[k]=p[k];
+    return r;
+#endif
+}
+
+
+// gather for the first n lanes only; the other lanes are zero or hold
+// values loaded from their (valid) indices
+template<int n>
+inline vfloat8 gather_first(const float* base, vint8 idx)
+{
+#if defined(__AVX2__)
+    if (n>4)
+        return gather(base, idx);
+
+    if (n>2)
+        return { _mm256_insertf128_ps(_mm256_setzero_ps(), _mm_i32gather_ps(base, _mm256_castsi256_si128(idx.v), 4), 0) };
+
+    // for one or two lanes, separate loads beat the gather instruction
+    const __m128i i=_mm256_castsi256_si128(idx.v);
+    return { _mm256_setr_ps(base[_mm_cvtsi128_si32(i)], n>1 ? base[_mm_extract_epi32(i, 1)] : 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f) };
+#elif defined(__SSE2__)
+    alignas(16) int32_t i[8];
+    idx.store(i);
+
+    return {
+        _mm_setr_ps(base[i[0]], n>1 ? base[i[1]] : 0.0f, n>2 ? base[i[2]] : 0.0f, n>3 ? base[i[3]] : 0.0f),
+        n>4 ? _mm_setr_ps(base[i[4]], n>5 ? base[i[5]] : 0.0f, n>6 ? base[i[6]] : 0.0f, n>7 ? base[i[7]] : 0.0f) : _mm_setzero_ps()
+    };
+#else
+    vfloat8 r=vfloat8::zero();
+    for (int k=0;k<n;k++) r.f[k]=base[idx.i[k]];
+    return r;
+#endif
+}
+
+
+// 16-bit variant of gather_first; only the low 16 bits of each lane are
+// defined, so base must be readable for one element past every index
+template<int n>
+inline vint8 gather16_first(const uint16_t* base, vint8 idx)
+{
+#if defined(__AVX2__)
+    if (n>4)
+        return { _mm256_i32gather_epi32((const int*) base, idx.v, 2) };
+
+    if (n>2)
+        return { _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_i32gather_epi32((const int*) base, _mm256_castsi256_si128(idx.v), 2), 0) };
+
+    const __m128i i=_mm256_castsi256_si128(idx.v);
+    return { _mm256_setr_epi32(base[_mm_cvtsi128_si32(i)], n>1 ? base[_mm_extract_epi32(i, 1)] : 0, 0, 0, 0, 0, 0, 0) };
+#elif defined(__SSE2__)
+    alignas(16) int32_t i[8];
+    idx.store(i);
+
+    return {
+        _mm_setr_epi32(base[i[0]], n>1 ? base[i[1]] : 0, n>2 ? base[i[2]] : 0, n>3 ? base[i[3]] : 0),
+        n>4 ? _mm_setr_epi32(base[i[4]], n>5 ? base[i[5]] : 0, n>6 ? base[i[6]] : 0, n>7 ? base[i[7]] : 0) : _mm_setzero_si128()
+    };
+#else
+    vint8 r=vint8::broadcast(0);
+    for (int k=0;k<n;k++) r.i[k]=base[idx.i[k]];
+    return r;
+#endif
+}
+
+
+// zero-extending load of the first n of eight 16-bit values; for n==3
+// the fourth value is read as well
+template<int n>
+inline vint8 load16_first(const uint16_t* p)
+{
+#if defined(__SSE2__)
+    __m128i x;
+    if (n>4)
+        x=_mm_loadu_si128((const __m128i*) p);
+    else if (n>2)
+        x=_mm_loadl_epi64((const __m128i*) p);
+    else {
+        int32_t pair=p[0];
+        if (n>1)
+            pair|=(int32_t) p[1]<<16;
+        x=_mm_cvtsi32_si128(pair);
+    }
+
+#if defined(__AVX2__)
+    return { _mm256_cvtepu16_epi32(x) };
+#else
+    return { _mm_unpacklo_epi16(x, _mm_setzero_si128()), _mm_unpackhi_epi16(x, _mm_setzero_si128()) };
+#endif
+#else
+    vint8 r=vint8::broadcast(0);
+    for (int k=0;k<n;k++) r.i[k]=p[k];
+    return r;
+#endif
+}
+
+
+// stores the low 16 bits of every lane to p[0..7]
+inline void store16(uint16_t* p, vint8 a)
+{
+#if defined(__AVX2__)
+    const __m256i x=_mm256_srai_epi32(_mm256_slli_epi32(a.v, 16), 16);
+    _mm_storeu_si128((__m128i*) p, _mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1)));
+#elif defined(__SSE2__)
+    const __m128i lo=_mm_srai_epi32(_mm_slli_epi32(a.lo, 16), 16);
+    const __m128i hi=_mm_srai_epi32(_mm_slli_epi32(a.hi, 16), 16);
+    _mm_storeu_si128((__m128i*) p, _mm_packs_epi32(lo, hi));
+#else
+    for (int k=0;k<8;k++) p[k]=(uint16_t) a.i[k];
+#endif
+}
+
+
+// half precision in the low 16 bits, clamped, without subnormal floats
+inline vfloat8 half_to_float(vint8 h)
+{
+    const vint8 em=shl<13>(h & vint8::broadcast(0x7fff));
+    const vint8 sign=shl<16>(h & vint8::broadcast(0x8000));
+
+    const vint8 normal=em + vint8::broadcast((127-15)<<23);
+
+    // for a zero exponent take 2^-14*(1+m) - 2^-14
+    const vint8 subnormal=as_int(as_float(normal + vint8::broadcast(1<<23)) - vfloat8::broadcast(6.103515625e-05f));
+    const vint8 zero_exponent=(em & vint8::broadcast(0x1f<<23))==vint8::broadcast(0);
+
+    return as_float(select(zero_exponent, subnormal, normal) ^ sign);
+}
+
+inline vint8 float_to_half(vfloat8 x)
+{
+    const vint8 bits=as_int(x);
+    const vint8 sign=shr<16>(bits & vint8::broadcast(0x80000000));
+
+    const vfloat8 maxhalf=vfloat8::broadcast(65504.0f);
+    vint8 f=bits & vint8::broadcast(0x7fffffff);
+    f=select(as_int(maxhalf>=as_float(f)), f, as_int(maxhalf));
+
+    // rebias the exponent and round away the lower 13 mantissa bits
+    const vint8 odd=shr<13>(f) & vint8::broadcast(1);
+    const vint8 normal=shr<13>(f + vint8::broadcast(-(112<<23) + 0xfff) + odd);
+
+    // below 2^-14 the addition of 0.5 aligns the mantissa with the half's
+    const vfloat8 half=vfloat8::broadcast(0.5f);
+    const vint8 subnormal=as_int(as_float(f) + half) - as_int(half);
+    const vfloat8 small=vfloat8::broadcast(6.103515625e-05f)>=as_float(f);
+
+    return select(as_int(small), subnormal, normal) ^ sign;
+}
+
+
+// half precision samples as floats, on F16C where available
+template<int n>
+inline vfloat8 load_half_first(const uint16_t* p)
+{
+#if defined(__F16C__) && defined(__AVX2__)
+    __m128i x;
+    if (n>4)
+        x=_mm_loadu_si128((const __m128i*) p);
+    else if (n>2)
+        x=_mm_loadl_epi64((const __m128i*) p);
+    else
+        x=_mm_cvtsi32_si128(n>1 ? (int32_t) p[0] | (int32_t) p[1]<<16 : p[0]);
+
+    return { _mm256_cvtph_ps(x) };
+#else
+    return half_to_float(load16_first<n>(p));
+#endif
+}
+
+template<int n>
+inline vfloat8 gather_half_first(const uint16_t* base, vint8 idx)
+{
+#if defined(__F16C__) && defined(__AVX2__)
+    const __m128i i=_mm256_castsi256_si128(idx.v);
+
+    if (n<=2)
+        return { _mm256_cvtph_ps(_mm_cvtsi32_si128(n>1 ? (int32_t) base[_mm_cvtsi128_si32(i)] | (int32_t) base[_mm_extract_epi32(i, 1)]<<16 : base[_mm_cvtsi128_si32(i)])) };
+
+    if (n<=4) {
+        const __m128i x=_mm_and_si128(_mm_i32gather_epi32((const int*) base, i, 2), _mm_set1_epi32(0xffff));
+        return { _mm256_cvtph_ps(_mm_packus_epi32(x, x)) };
+    }
+
+    const __m256i x=_mm256_and_si256(_mm256_i32gather_epi32((const int*) base, idx.v, 2), _mm256_set1_epi32(0xffff));
+    const __m256i packed=_mm256_permute4x64_epi64(_mm256_packus_epi32(x, x), 0x08);
+
+    return { _mm256_cvtph_ps(_mm256_castsi256_si128(packed)) };
+#else
+    return half_to_float(gather16_first<n>(base, idx));
+#endif
+}
+
+inline void store_half(uint16_t* p, vfloat8 x)
+{
+#if defined(__F16C__) && defined(__AVX2__)
+    const __m256 maxhalf=_mm256_set1_ps(65504.0f);
+    const __m256 clamped=_mm256_max_ps(_mm256_min_ps(x.v, maxhalf), _mm256_sub_ps(_mm256_setzero_ps(), maxhalf));
+
+    _mm_storeu_si128((__m128i*) p, _mm256_cvtps_ph(clamped, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+#else
+    store16(p, float_to_half(x));
+#endif
+}
+
+}
+
+using namespace OPAL_KERNEL_VARIANT;
+
+}
+
+#endif
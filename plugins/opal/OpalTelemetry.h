@@ -0,0 +1,79 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+#ifndef INCLUDE_STUDIOGEMS_OPALTELEMETRY_H
+#define INCLUDE_STUDIOGEMS_OPALTELEMETRY_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace StudioGemsDSP {
+
+// a snapshot for display, with the voice positions from 0 to 1
+struct TelemetryFrame {
+    static constexpr int NUM_VOICES=8;
+
+    float       position[NUM_VOICES];
+    int         numvoices;
+
+    float       input_peak;
+    float       output_peak;
+};
+
+
+// wait-free ring from the audio thread to the UI, which drops snapshots
+// when full
+class Telemetry {
+public:
+    static constexpr int    SIZE=64;
+    static constexpr float  INTERVAL=0.01f;
+
+    // audio thread only, returns false if the snapshot was dropped
+    bool push(const TelemetryFrame& frame)
+    {
+        const uint32_t h=head.load(std::memory_order_relaxed);
+
+        if (h - tail.load(std::memory_order_acquire)==SIZE)
+            return false;
+
+        frames[h % SIZE]=frame;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // UI thread only, returns false if there is no snapshot
+    bool pop(TelemetryFrame& frame)
+    {
+        const uint32_t t=tail.load(std::memory_order_relaxed);
+
+        if (head.load(std::memory_order_acquire)==t)
+            return false;
+
+        frame=frames[t % SIZE];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::atomic<uint32_t>   head { 0 };
+    TelemetryFrame          frames[SIZE];
+    std::atomic<uint32_t>   tail { 0 };
+};
+
+}
+
+#endif
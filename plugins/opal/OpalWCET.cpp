@@ -0,0 +1,544 @@
+/*
+ * Studio Gems DISTRHO Plugins
+ * Copyright (C) 2022 Stefan T. Boettner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE file.
+ */
+
+// worst-case time of PluginEngine::run on a periodic SCHED_FIFO thread,
+// "make wcet", with parameter jumps and the input falling silent
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "OpalKernels.h"
+#include "OpalEngine.h"
+
+using namespace StudioGemsDSP;
+
+namespace {
+
+struct Options {
+    int     rate=48000;
+    int     blocksize=256;
+    int     channels=1;
+
+    // the wake-up period in microseconds, by default the duration of a
+    // block; 0 runs the callbacks back to back
+    double  period=-1.0;
+
+    double  seconds=10.0;
+
+    // random parameter jumps per second
+    double  jumps=4.0;
+
+    int     priority=70;
+    int     cpu=-1;
+    int     outliers=10;
+
+    PluginParams    params;
+    storage_t       storage=STORAGE_FLOAT;
+};
+
+
+// the parameters that may jump, as bits of Record::changes; the
+// oversampling waits for the plugin to be activated, so it never does
+enum {
+    CHANGE_NUMVOICES=1,
+    CHANGE_DEPTH=2,
+    CHANGE_FREQUENCY=4,
+    CHANGE_INTERPOLATION=8,
+    CHANGE_WIDTH=16,
+    NUM_CHANGES=5
+};
+
+const char* const CHANGE_NAMES[NUM_CHANGES]={ "voices", "depth", "frequency", "quality", "width" };
+
+
+enum input_t {
+    INPUT_NOISE,
+    INPUT_SILENCE,
+    INPUT_FALLS_SILENT,
+    INPUT_RESUMES
+};
+
+const char* const INPUT_NAMES[]={ "noise", "silence", "falls silent", "resumes" };
+
+
+// one callback, times in nanoseconds
+struct Record {
+    uint32_t    duration;
+    uint32_t    lateness;
+    uint8_t     changes;
+    uint8_t     input;
+};
+
+
+struct Run {
+    const Options*      opts;
+    PluginEngine*       plugin;
+    std::vector<Record> records;
+
+    bool    realtime=false;
+};
+
+
+int64_t now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+
+uint32_t xorshift(uint32_t& x)
+{
+    x^=x<<13;
+    x^=x>>17;
+    x^=x<<5;
+    return x;
+}
+
+
+// the input of the given block, silent for the last of every five seconds
+bool silent(const Options& opts, long block)
+{
+    return (long) block * opts.blocksize / opts.rate % 5==4;
+}
+
+
+// waits for the deadline of every block and times the callback
+void* host(void* arg)
+{
+    Run& run=*(Run*) arg;
+    const Options& opts=*run.opts;
+    PluginEngine& plugin=*run.plugin;
+
+    const int n=opts.blocksize;
+
+    std::vector<std::vector<float>> in(opts.channels, std::vector<float>(n));
+    std::vector<std::vector<float>> out(opts.channels, std::vector<float>(n));
+
+    const float* inputs[MAX_CHANNELS];
+    float* outputs[MAX_CHANNELS];
+
+    for (int c=0;c<opts.channels;c++) {
+        inputs[c]=in[c].data();
+        outputs[c]=out[c].data();
+    }
+
+    const int64_t period=(int64_t) ((opts.period<0.0 ? 1e6 * n / opts.rate : opts.period) * 1000);
+
+    uint32_t noise=0x12345678, random=0x87654321;
+    double due=0.0;
+
+    int64_t deadline=now();
+
+    for (size_t k=0;k<run.records.size();k++) {
+        Record& record=run.records[k];
+
+        const bool quiet=silent(opts, k);
+        const bool before=k>0 && silent(opts, k-1);
+
+        record.input=quiet ? (before ? INPUT_SILENCE : INPUT_FALLS_SILENT) : (before ? INPUT_RESUMES : INPUT_NOISE);
+
+        for (int c=0;c<opts.channels;c++)
+            for (int i=0;i<n;i++)
+                in[c][i]=quiet ? 0.0f : (float) (xorshift(noise) >> 8) / (1<<24) - 0.5f;
+
+        // each jump sets one parameter to a random value
+        record.changes=0;
+
+        for (due+=opts.jumps * n / opts.rate;due>=1.0;due-=1.0) {
+            const PluginParams target=PluginParams::random(random);
+            PluginParams& params=plugin.params;
+
+            switch (xorshift(random) % NUM_CHANGES) {
+            case 0:
+                params.numvoices=target.numvoices;
+                record.changes|=CHANGE_NUMVOICES;
+                break;
+            case 1:
+                params.depth=target.depth;
+                record.changes|=CHANGE_DEPTH;
+                break;
+            case 2:
+                params.frequency=target.frequency;
+                record.changes|=CHANGE_FREQUENCY;
+                break;
+            case 3:
+                params.interpolation=target.interpolation;
+                record.changes|=CHANGE_INTERPOLATION;
+                break;
+            default:
+                params.width=target.width;
+                record.changes|=CHANGE_WIDTH;
+                break;
+            }
+        }
+
+        if (period>0) {
+            deadline+=period;
+
+            timespec t;
+            t.tv_sec=deadline / 1000000000;
+            t.tv_nsec=deadline % 1000000000;
+
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, nullptr)==EINTR);
+        }
+
+        const int64_t start=now();
+
+        plugin.run(inputs, outputs, n);
+
+        const int64_t stop=now();
+
+        record.duration=(uint32_t) std::min<int64_t>(stop - start, UINT32_MAX);
+        record.lateness=period>0 ? (uint32_t) std::min<int64_t>(std::max<int64_t>(start - deadline, 0), UINT32_MAX) : 0;
+
+        // as the UI would
+        TelemetryFrame frame;
+        while (plugin.telemetry.pop(frame));
+    }
+
+    return nullptr;
+}
+
+
+void usage(const char* name)
+{
+    printf("Usage: %s [options]\n"
+           "\n"
+           "  -r, --rate=HZ           sample rate in Hz (48000)\n"
+           "  -b, --block=N           block size in frames, 1 to 8192 (256)\n"
+           "  -p, --period=US         wake-up period in microseconds, 0 for none (one block)\n"
+           "  -s, --seconds=S         audio processed (10)\n"
+           "  -a, --jumps=N           random parameter jumps per second (4)\n"
+           "  -c, --channels=N        channels, 1 to %d (1)\n"
+           "  -v, --voices=N          initial voice count, 1 to %d (1)\n"
+           "  -q, --quality=N         initial interpolation, 0=linear ... 4=sinc (0)\n"
+           "  -o, --oversampling=N    oversampling, 1, 2 or 4, fixed from activation (1)\n"
+           "  -m, --storage=S         delay line storage, float or half (float)\n"
+           "  -P, --priority=N        SCHED_FIFO priority of the callback thread (70)\n"
+           "  -k, --cpu=N             pin the callback thread to a CPU\n"
+           "  -n, --outliers=N        slowest callbacks to list (10)\n"
+           "\n"
+           "Set OPAL_KERNELS=baseline|avx2|avx512 to force a kernel variant.\n",
+           name, MAX_CHANNELS, MAX_ENSEMBLE);
+}
+
+
+Options parse_options(int argc, char** argv)
+{
+    static const option longopts[]={
+        { "rate",       required_argument,  nullptr, 'r' },
+        { "block",      required_argument,  nullptr, 'b' },
+        { "period",     required_argument,  nullptr, 'p' },
+        { "seconds",    required_argument,  nullptr, 's' },
+        { "jumps",      required_argument,  nullptr, 'a' },
+        { "channels",   required_argument,  nullptr, 'c' },
+        { "voices",     required_argument,  nullptr, 'v' },
+        { "quality",    required_argument,  nullptr, 'q' },
+        { "oversampling", required_argument, nullptr, 'o' },
+        { "storage",    required_argument,  nullptr, 'm' },
+        { "priority",   required_argument,  nullptr, 'P' },
+        { "cpu",        required_argument,  nullptr, 'k' },
+        { "outliers",   required_argument,  nullptr, 'n' },
+        { "help",       no_argument,        nullptr, 'h' },
+        { nullptr,      0,                  nullptr, 0 }
+    };
+
+    Options opts;
+
+    int c;
+    while ((c=getopt_long(argc, argv, "r:b:p:s:a:c:v:q:o:m:P:k:n:h", longopts, nullptr))!=-1) {
+        switch (c) {
+        case 'r':
+            opts.rate=atoi(optarg);
+            break;
+        case 'b':
+            opts.blocksize=atoi(optarg);
+            break;
+        case 'p':
+            opts.period=atof(optarg);
+            break;
+        case 's':
+            opts.seconds=atof(optarg);
+            break;
+        case 'a':
+            opts.jumps=atof(optarg);
+            break;
+        case 'c':
+            opts.channels=atoi(optarg);
+            break;
+        case 'v':
+            opts.params.numvoices=atoi(optarg);
+            break;
+        case 'q':
+            opts.params.interpolation=atoi(optarg);
+            break;
+        case 'o':
+            opts.params.oversampling=atoi(optarg);
+            break;
+        case 'm':
+            if (!strcmp(optarg, "half"))
+                opts.storage=STORAGE_HALF;
+            else if (strcmp(optarg, "float")) {
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'P':
+            opts.priority=atoi(optarg);
+            break;
+        case 'k':
+            opts.cpu=atoi(optarg);
+            break;
+        case 'n':
+            opts.outliers=atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    const bool valid=optind==argc && opts.rate>=8000 &&
+                     opts.blocksize>=1 && opts.blocksize<=8192 &&
+                     opts.seconds>0.0 && opts.jumps>=0.0 &&
+                     opts.channels>=1 && opts.channels<=MAX_CHANNELS &&
+                     opts.params.numvoices>=1 && opts.params.numvoices<=MAX_ENSEMBLE &&
+                     opts.params.interpolation>=0 && opts.params.interpolation<NUM_INTERPOLATIONS &&
+                     (opts.params.oversampling==1 || opts.params.oversampling==2 || opts.params.oversampling==4) &&
+                     opts.priority>=sched_get_priority_min(SCHED_FIFO) && opts.priority<=sched_get_priority_max(SCHED_FIFO) &&
+                     opts.outliers>=0;
+
+    if (!valid) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    return opts;
+}
+
+
+// runs the host thread at SCHED_FIFO if allowed
+bool start(Run& run)
+{
+    const Options& opts=*run.opts;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    sched_param param;
+    param.sched_priority=opts.priority;
+
+    // rather than the default of several MB, which all would be locked
+    pthread_attr_setstacksize(&attr, 1<<20);
+
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+
+#ifdef __linux__
+    if (opts.cpu>=0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(opts.cpu, &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+#endif
+
+    pthread_t thread;
+    int error=pthread_create(&thread, &attr, host, &run);
+
+    run.realtime=error==0;
+
+    if (error==EPERM) {
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        error=pthread_create(&thread, &attr, host, &run);
+    }
+
+    pthread_attr_destroy(&attr);
+
+    if (error) {
+        fprintf(stderr, "cannot start the callback thread: %s\n", strerror(error));
+        return false;
+    }
+
+    pthread_join(thread, nullptr);
+    return true;
+}
+
+
+// the value at the given fraction of the sorted samples, nearest rank
+uint32_t percentile(const std::vector<uint32_t>& sorted, double p)
+{
+    const size_t rank=(size_t) ceil(p * sorted.size());
+
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+
+void print_distribution(const char* title, std::vector<uint32_t> ns, double budget)
+{
+    std::sort(ns.begin(), ns.end());
+
+    double mean=0.0;
+    for (uint32_t x: ns)
+        mean+=x;
+    mean/=ns.size();
+
+    printf("# %s in us, and in %% of the duration of a block\n", title);
+    printf("#      min   median     mean      p90      p99    p99.9   p99.99      max\n");
+    printf("  %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n",
+           ns.front() / 1e3, percentile(ns, 0.5) / 1e3, mean / 1e3, percentile(ns, 0.9) / 1e3,
+           percentile(ns, 0.99) / 1e3, percentile(ns, 0.999) / 1e3, percentile(ns, 0.9999) / 1e3, ns.back() / 1e3);
+    printf("  %7.1f%% %7.1f%% %7.1f%% %7.1f%% %7.1f%% %7.1f%% %7.1f%% %7.1f%%\n",
+           100 * ns.front() / budget, 100 * percentile(ns, 0.5) / budget, 100 * mean / budget, 100 * percentile(ns, 0.9) / budget,
+           100 * percentile(ns, 0.99) / budget, 100 * percentile(ns, 0.999) / budget, 100 * percentile(ns, 0.9999) / budget, 100 * ns.back() / budget);
+
+    // bins of a quarter octave, from 1 us, with a bar on a log scale
+    constexpr int BINS_PER_OCTAVE=4;
+
+    std::vector<long> bins;
+    for (uint32_t x: ns) {
+        const int bin=x>1000 ? (int) ceil(log2(x / 1e3) * BINS_PER_OCTAVE) : 0;
+
+        if (bin>=(int) bins.size())
+            bins.resize(bin + 1);
+        bins[bin]++;
+    }
+
+    printf("#    up to us    calls\n");
+
+    for (size_t bin=0;bin<bins.size();bin++) {
+        if (!bins[bin])
+            continue;
+
+        const double upper=exp2((double) bin / BINS_PER_OCTAVE);
+
+        printf("  %10.1f %8ld  %.*s%s\n", upper, bins[bin], 1 + (int) log2((double) bins[bin]),
+               "##################################################", upper * 1e3>budget ? "   over budget" : "");
+    }
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    const Options opts=parse_options(argc, argv);
+
+    const long count=(long) ceil(opts.seconds * opts.rate / opts.blocksize);
+    const double budget=1e9 * opts.blocksize / opts.rate;
+
+    PluginEngine plugin(opts.channels, opts.storage);
+    plugin.params=opts.params;
+    plugin.activate(opts.rate, 0);
+
+    Run run;
+    run.opts=&opts;
+    run.plugin=&plugin;
+    run.records.resize(count);
+
+    // page faults are no part of the callback; all is allocated by now,
+    // as the limit on locked memory may not leave room for much more
+    const bool locked=mlockall(MCL_CURRENT | MCL_FUTURE)==0;
+
+    if (!start(run))
+        return EXIT_FAILURE;
+
+    if (!run.realtime)
+        fprintf(stderr, "note: no permission for SCHED_FIFO, the callbacks ran at normal priority\n");
+    if (!locked)
+        fprintf(stderr, "note: no permission to lock the memory, the callbacks may have taken page faults\n");
+
+    printf("# kernels %s, %s storage, %d channel(s) at %d Hz, blocks of %d (%.1f us), period %s, %ld callbacks, %g jumps/s, %s%s\n",
+           select_kernels().name, opts.storage==STORAGE_HALF ? "half" : "float", opts.channels, opts.rate,
+           opts.blocksize, budget / 1e3, opts.period<0.0 ? "one block" : opts.period==0.0 ? "none" : "as given",
+           count, opts.jumps, run.realtime ? "SCHED_FIFO" : "normal priority", locked ? ", memory locked" : "");
+
+    std::vector<uint32_t> durations, lateness;
+    long overruns=0, misses=0;
+
+    for (const Record& record: run.records) {
+        durations.push_back(record.duration);
+        lateness.push_back(record.lateness);
+
+        overruns+=record.duration>budget;
+        misses+=record.lateness + record.duration>budget;
+    }
+
+    print_distribution("execution time per callback", durations, budget);
+    printf("#\n");
+
+    if (opts.period!=0.0) {
+        print_distribution("wake-up latency", lateness, budget);
+        printf("#\n");
+    }
+
+    printf("# %ld callback(s) took longer than a block, %ld finished later than a block after their deadline\n", overruns, misses);
+
+    // the slowest ones, where in the stream they were, and what happened there
+    std::vector<long> order(count);
+    for (long k=0;k<count;k++)
+        order[k]=k;
+
+    const long shown=std::min<long>(opts.outliers, count);
+    std::partial_sort(order.begin(), order.begin() + shown, order.end(), [&](long a, long b) {
+        return run.records[a].duration>run.records[b].duration;
+    });
+
+    if (shown>0) {
+        printf("#\n# slowest callbacks\n");
+        printf("#  callback        frame   seconds         us    load  input         changed\n");
+    }
+
+    for (long i=0;i<shown;i++) {
+        const long k=order[i];
+        const Record& record=run.records[k];
+
+        char changes[128]="";
+        for (int c=0;c<NUM_CHANGES;c++) {
+            if (record.changes & 1<<c) {
+                const size_t used=strlen(changes);
+                snprintf(changes + used, sizeof(changes) - used, "%s%s", used ? "," : "", CHANGE_NAMES[c]);
+            }
+        }
+
+        if (k==0) {
+            const size_t used=strlen(changes);
+            snprintf(changes + used, sizeof(changes) - used, "%sfirst call", used ? "," : "");
+        }
+
+        printf("  %9ld %12ld %9.3f %10.1f %6.1f%%  %-13s %s\n",
+               k, k * opts.blocksize, (double) k * opts.blocksize / opts.rate,
+               record.duration / 1e3, 100 * record.duration / budget, INPUT_NAMES[record.input], changes);
+    }
+
+    return 0;
+}
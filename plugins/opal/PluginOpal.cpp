@@ -15,88 +15,24 @@
  * For a full copy of the GNU General Public License see the LICENSE file.
  */
 
+#include <atomic>
 #include "PluginOpal.h"
 
 START_NAMESPACE_DISTRHO
 
+using namespace StudioGemsDSP;
 
-class DistrhoPluginOpal::Delay {
-    int     length;
-    float*  buffer;
+static_assert(TelemetryFrame::NUM_VOICES==MAX_VOICES, "telemetry must hold all modulation voices");
 
-    int     wrptr=0;
 
-public:
-    Delay(int length):length(length)
-    {
-        buffer=new float[length];
-
-        for (int i=0;i<length;i++)
-            buffer[i]=0.0f;
-    }
-
-    ~Delay()
-    {
-        delete[] buffer;
-    }
-
-    void put(float value)
-    {
-        buffer[wrptr++]=value;
-        if (wrptr==length)
-            wrptr=0;
-    }
-
-    float operator()(float delay) const
-    {
-        int delay_int=(int) floorf(delay);
-        float t=delay - delay_int;
-        
-        int pos=wrptr - delay_int;
-        if (pos<0)
-            pos+=length;
-
-        // FIXME: implement some better interpolation
-        if (pos==0)
-            return buffer[0]*(1.0f-t) + buffer[length-1]*t;
-        else
-            return buffer[pos]*(1.0f-t) + buffer[pos-1]*t;
-    }
-};
-
-
-class DistrhoPluginOpal::BSplineNoise {
-    float   coeffs[4] {};
-    float   phase=0.0f;
-
-public:
-    float operator()(float freq)
-    {
-        const float t=phase;
-
-        const float val=coeffs[0]*(1-t)*(1-t)*(1-t)/6 +
-                        coeffs[1]*(3*t*t*t - 6*t*t + 4)/6 +
-                        coeffs[2]*(-3*t*t*t + 3*t*t + 3*t + 1)/6 +
-                        coeffs[3]*t*t*t/6;
-
-        phase+=freq;
-        if (phase>=1.0f) {
-            phase-=1.0f;
-            
-            coeffs[0]=coeffs[1];
-            coeffs[1]=coeffs[2];
-            coeffs[2]=coeffs[3];
-            coeffs[3]=ldexpf(rand()&0xfffff, -20);
-        }
-
-        return val;
-    }
-};
-
-
-DistrhoPluginOpal::DistrhoPluginOpal():Plugin(NUM_PARAMETERS, 0, 0)
+DistrhoPluginOpal::DistrhoPluginOpal():
+    Plugin(NUM_PARAMETERS, 0, 0),
+    engine(OPAL_NUM_CHANNELS)
 {
-    deactivate();
+    // every instance gets its own modulation sequence, but which one
+    // depends on the order they are created in, unless a seed is set
+    static std::atomic<uint32_t> instances(0);
+    instance=instances++;
 }
 
 
@@ -107,7 +43,7 @@ DistrhoPluginOpal::~DistrhoPluginOpal()
 
 void DistrhoPluginOpal::initAudioPort(bool input, uint32_t index, AudioPort& port)
 {
-    port.groupId = kPortGroupMono;
+    port.groupId = OPAL_NUM_CHANNELS==1 ? kPortGroupMono : OPAL_NUM_CHANNELS==2 ? kPortGroupStereo : kPortGroupNone;
 
     Plugin::initAudioPort(input, index, port);
 }
@@ -122,7 +58,7 @@ void DistrhoPluginOpal::initParameter(uint32_t index, Parameter& parameter)
         parameter.symbol     = "numvoices";
         parameter.ranges.def = 1.0f;
         parameter.ranges.min = 1.0f;
-        parameter.ranges.max = 8.0f;
+        parameter.ranges.max = MAX_ENSEMBLE;
         break;
     case PARAM_DEPTH:
         parameter.hints      = kParameterIsAutomatable;
@@ -130,7 +66,7 @@ void DistrhoPluginOpal::initParameter(uint32_t index, Parameter& parameter)
         parameter.symbol     = "depth";
         parameter.ranges.def = 10.0f;
         parameter.ranges.min = 0.0f;
-        parameter.ranges.max = 100.0f;
+        parameter.ranges.max = MAX_DEPTH;
         break;
     case PARAM_FREQUENCY:
         parameter.hints      = kParameterIsAutomatable | kParameterIsLogarithmic;
@@ -140,6 +76,153 @@ void DistrhoPluginOpal::initParameter(uint32_t index, Parameter& parameter)
         parameter.ranges.min = 0.1f;
         parameter.ranges.max = 10.0f;
         break;
+    case PARAM_INTERPOLATION:
+        parameter.hints      = kParameterIsInteger;
+        parameter.name       = "Quality";
+        parameter.symbol     = "quality";
+        parameter.ranges.def = INTERP_LINEAR;
+        parameter.ranges.min = INTERP_LINEAR;
+        parameter.ranges.max = INTERP_SINC;
+        parameter.enumValues.count = NUM_INTERPOLATIONS;
+        parameter.enumValues.restrictedMode = true;
+        {
+            ParameterEnumerationValue* const values=new ParameterEnumerationValue[NUM_INTERPOLATIONS];
+            parameter.enumValues.values=values;
+
+            values[0].label="Linear";
+            values[0].value=INTERP_LINEAR;
+            values[1].label="Hermite";
+            values[1].value=INTERP_HERMITE;
+            values[2].label="Lagrange";
+            values[2].value=INTERP_LAGRANGE;
+            values[3].label="Allpass";
+            values[3].value=INTERP_ALLPASS;
+            values[4].label="Sinc";
+            values[4].value=INTERP_SINC;
+        }
+        break;
+#if OPAL_NUM_CHANNELS>1
+    case PARAM_WIDTH:
+        parameter.hints      = kParameterIsAutomatable;
+        parameter.name       = "Width";
+        parameter.symbol     = "width";
+        parameter.ranges.def = 0.5f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 1.0f;
+        break;
+#endif
+    case PARAM_OVERSAMPLING:
+        // not automatable, it takes effect when the plugin is activated
+        parameter.hints      = kParameterIsInteger;
+        parameter.name       = "Oversampling";
+        parameter.symbol     = "oversampling";
+        parameter.ranges.def = 1.0f;
+        parameter.ranges.min = 1.0f;
+        parameter.ranges.max = 4.0f;
+        parameter.enumValues.count = 3;
+        parameter.enumValues.restrictedMode = true;
+        {
+            ParameterEnumerationValue* const values=new ParameterEnumerationValue[3];
+            parameter.enumValues.values=values;
+
+            values[0].label="Off";
+            values[0].value=1.0f;
+            values[1].label="2x";
+            values[1].value=2.0f;
+            values[2].label="4x";
+            values[2].value=4.0f;
+        }
+        break;
+    case PARAM_OFFLINE:
+        // as the oversampling
+        parameter.hints      = kParameterIsBoolean | kParameterIsInteger;
+        parameter.name       = "Offline";
+        parameter.symbol     = "offline";
+        parameter.ranges.def = 0.0f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 1.0f;
+        break;
+    case PARAM_SEED:
+        // saved with the project, so that it reproduces its modulation
+        parameter.hints      = kParameterIsInteger;
+        parameter.name       = "Seed";
+        parameter.symbol     = "seed";
+        parameter.ranges.def = 0.0f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 65535.0f;
+        break;
+    case PARAM_LOAD_RESET:
+        parameter.hints      = kParameterIsTrigger;
+        parameter.name       = "Load Reset";
+        parameter.symbol     = "load_reset";
+        parameter.ranges.def = 0.0f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 1.0f;
+        break;
+    case PARAM_LOAD_MEAN:
+        parameter.hints      = kParameterIsOutput;
+        parameter.name       = "Load Avg";
+        parameter.symbol     = "load_mean";
+        parameter.unit       = "%";
+        parameter.ranges.def = 0.0f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 200.0f;
+        break;
+    case PARAM_LOAD_P99:
+        parameter.hints      = kParameterIsOutput;
+        parameter.name       = "Load p99";
+        parameter.symbol     = "load_p99";
+        parameter.unit       = "%";
+        parameter.ranges.def = 0.0f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 200.0f;
+        break;
+    case PARAM_LOAD_MAX:
+        parameter.hints      = kParameterIsOutput;
+        parameter.name       = "Load Max";
+        parameter.symbol     = "load_max";
+        parameter.unit       = "%";
+        parameter.ranges.def = 0.0f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 200.0f;
+        break;
+    case PARAM_OVERRUNS:
+        parameter.hints      = kParameterIsOutput | kParameterIsInteger;
+        parameter.name       = "Overruns";
+        parameter.symbol     = "overruns";
+        parameter.ranges.def = 0.0f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 1e6f;
+        break;
+    case PARAM_INPUT_PEAK:
+        parameter.hints      = kParameterIsOutput;
+        parameter.name       = "Input Peak";
+        parameter.symbol     = "input_peak";
+        parameter.ranges.def = 0.0f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 2.0f;
+        break;
+    case PARAM_OUTPUT_PEAK:
+        parameter.hints      = kParameterIsOutput;
+        parameter.name       = "Output Peak";
+        parameter.symbol     = "output_peak";
+        parameter.ranges.def = 0.0f;
+        parameter.ranges.min = 0.0f;
+        parameter.ranges.max = 2.0f;
+        break;
+    default:
+        // where each modulation voice is within the depth
+        if (index>=PARAM_POSITION && index<NUM_PARAMETERS) {
+            const int voice=index - PARAM_POSITION + 1;
+
+            parameter.hints      = kParameterIsOutput;
+            parameter.name       = String("Voice ") + String(voice);
+            parameter.symbol     = String("position") + String(voice);
+            parameter.ranges.def = 0.0f;
+            parameter.ranges.min = 0.0f;
+            parameter.ranges.max = 1.0f;
+        }
+        break;
     }
 }
 
@@ -148,12 +231,39 @@ float DistrhoPluginOpal::getParameterValue(uint32_t index) const
 {
     switch (index) {
     case PARAM_NUMVOICES:
-        return numvoices;
+        return engine.params.numvoices;
     case PARAM_DEPTH:
-        return depth;
+        return engine.params.depth;
     case PARAM_FREQUENCY:
-        return frequency;
+        return engine.params.frequency;
+    case PARAM_INTERPOLATION:
+        return engine.params.interpolation;
+#if OPAL_NUM_CHANNELS>1
+    case PARAM_WIDTH:
+        return engine.params.width;
+#endif
+    case PARAM_OVERSAMPLING:
+        return engine.params.oversampling;
+    case PARAM_OFFLINE:
+        return engine.params.offline ? 1.0f : 0.0f;
+    case PARAM_SEED:
+        return seed;
+    case PARAM_LOAD_MEAN:
+        return engine.load.mean() * 100.0f;
+    case PARAM_LOAD_P99:
+        return engine.load.p99() * 100.0f;
+    case PARAM_LOAD_MAX:
+        return engine.load.max() * 100.0f;
+    case PARAM_OVERRUNS:
+        return engine.load.overruns();
+    case PARAM_INPUT_PEAK:
+        return engine.published.input_peak;
+    case PARAM_OUTPUT_PEAK:
+        return engine.published.output_peak;
     default:
+        if (index>=PARAM_POSITION && index<NUM_PARAMETERS)
+            return engine.published.position[index - PARAM_POSITION];
+
         return 0.0;
     }
 }
@@ -163,13 +273,34 @@ void  DistrhoPluginOpal::setParameterValue(uint32_t index, float value)
 {
     switch (index) {
     case PARAM_NUMVOICES:
-        numvoices=(int) value;
+        engine.params.numvoices=(int) value;
         break;
     case PARAM_DEPTH:
-        depth=value;
+        engine.params.depth=value;
         break;
     case PARAM_FREQUENCY:
-        frequency=value;
+        engine.params.frequency=value;
+        break;
+    case PARAM_INTERPOLATION:
+        engine.params.interpolation=(int) value;
+        break;
+#if OPAL_NUM_CHANNELS>1
+    case PARAM_WIDTH:
+        engine.params.width=value;
+        break;
+#endif
+    case PARAM_OVERSAMPLING:
+        engine.params.oversampling=(int) value;
+        break;
+    case PARAM_OFFLINE:
+        engine.params.offline=value>0.5f;
+        break;
+    case PARAM_SEED:
+        seed=(int) value;
+        break;
+    case PARAM_LOAD_RESET:
+        if (value>0.5f)
+            engine.load.reset();
         break;
     }
 }
@@ -177,35 +308,21 @@ void  DistrhoPluginOpal::setParameterValue(uint32_t index, float value)
 
 void DistrhoPluginOpal::activate()
 {
-    delay=new Delay(lrint(getSampleRate()*1.5));
-    noise=new BSplineNoise[8];
+    engine.activate(getSampleRate(), seed>0 ? seed : instance);
+
+    setLatency(engine.latency());
 }
 
 
 void DistrhoPluginOpal::deactivate()
 {
-    delete delay;
-    delay=nullptr;
-
-    delete[] noise;
-    noise=nullptr;
+    engine.deactivate();
 }
 
 
 void DistrhoPluginOpal::run(const float** inputs, float** outputs, uint32_t frames)
 {
-    float maxoffset=(float) (depth*getSampleRate()/1000);
-    float freq=(float) (frequency / getSampleRate());
-
-    for (uint32_t i=0;i<frames;i++) {
-        delay->put(inputs[0][i]);
-
-        float result=0.0f;
-        for (int j=0;j<numvoices;j++)
-            result+=(*delay)(maxoffset * noise[j](freq));
-
-        outputs[0][i]=result / numvoices;
-    }
+    engine.run(inputs, outputs, frames);
 }
 
 
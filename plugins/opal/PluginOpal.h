@@ -19,6 +19,7 @@
 #define DISTRHO_PLUGIN_OPAL_H_INCLUDED
 
 #include "DistrhoPlugin.hpp"
+#include "OpalEngine.h"
 
 START_NAMESPACE_DISTRHO
 
@@ -31,19 +32,40 @@ public:
         PARAM_NUMVOICES,
         PARAM_DEPTH,
         PARAM_FREQUENCY,
-        NUM_PARAMETERS
+        PARAM_INTERPOLATION,
+#if OPAL_NUM_CHANNELS>1
+        PARAM_WIDTH,
+#endif
+        PARAM_OVERSAMPLING,
+        PARAM_OFFLINE,
+        PARAM_SEED,
+        PARAM_LOAD_RESET,
+        PARAM_LOAD_MEAN,
+        PARAM_LOAD_P99,
+        PARAM_LOAD_MAX,
+        PARAM_OVERRUNS,
+        PARAM_INPUT_PEAK,
+        PARAM_OUTPUT_PEAK,
+        PARAM_POSITION,
+        NUM_PARAMETERS=PARAM_POSITION + StudioGemsDSP::TelemetryFrame::NUM_VOICES
     };
 
     DistrhoPluginOpal();
     ~DistrhoPluginOpal() override;
 
+    // snapshots for the UI, which must be drained from one thread only
+    StudioGemsDSP::Telemetry& get_telemetry()
+    {
+        return engine.telemetry;
+    }
+
 protected:
     // -------------------------------------------------------------------
     // Information
 
     const char* getLabel() const noexcept override
     {
-        return "OpalChorus";
+        return DISTRHO_PLUGIN_NAME;
     }
 
     const char* getDescription() const override
@@ -73,7 +95,7 @@ protected:
 
     int64_t getUniqueId() const noexcept override
     {
-        return d_cconst('S', 'G', 'O', 'p');
+        return d_cconst('S', 'G', 'O', OPAL_NUM_CHANNELS==1 ? 'p' : '0'+OPAL_NUM_CHANNELS);
     }
 
     // -------------------------------------------------------------------
@@ -98,15 +120,12 @@ protected:
     // -------------------------------------------------------------------
 
 private:
-    class Delay;
-    class BSplineNoise;
-
-    Delay*          delay=nullptr;
-    BSplineNoise*   noise=nullptr;
+    // the parameters, the chorus and what run does with them
+    StudioGemsDSP::PluginEngine engine;
 
-    int     numvoices=0;
-    float   depth=0.0f;
-    float   frequency=0.0f;
+    // 0 for one counted up per instance; takes effect on activation
+    int         seed=0;
+    uint32_t    instance;
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DistrhoPluginOpal)
 };
@@ -15,11 +15,58 @@
  * For a full copy of the GNU General Public License see the LICENSE file.
  */
 
+#include <algorithm>
 #include "UIOpal.h"
+#include "PluginOpal.h"
 
 START_NAMESPACE_DISTRHO
 
-DistrhoUIOpal::DistrhoUIOpal()
+using StudioGemsDSP::TelemetryFrame;
+
+ModulationDisplay::ModulationDisplay(Widget* parent, uint x0, uint y0, uint width, uint height):
+    GraphDisplay(parent, x0, y0, width, height)
+{
+}
+
+
+void ModulationDisplay::draw_graph(cairo_t* cr)
+{
+    const float w=getWidth();
+    const float h=getHeight();
+
+    // the voices, over all but the bottom quarter
+    cairo_set_line_width(cr, 2.0);
+    cairo_set_source_rgb(cr, 0.25, 0.6, 1.0);
+
+    for (int i=0;i<std::min(telemetry.numvoices, TelemetryFrame::NUM_VOICES);i++) {
+        const float x=8.0f + telemetry.position[i]*(w-16.0f);
+
+        cairo_move_to(cr, x, 8.0f);
+        cairo_line_to(cr, x, h*0.75f - 4.0f);
+    }
+
+    cairo_stroke(cr);
+
+    // the peaks, full width at 0 dBFS, and red beyond
+    const float peaks[2]={ telemetry.input_peak, telemetry.output_peak };
+
+    for (int i=0;i<2;i++) {
+        const float y=h*0.75f + i*h*0.125f;
+
+        if (peaks[i]>1.0f)
+            cairo_set_source_rgb(cr, 1.0, 0.25, 0.15);
+        else
+            cairo_set_source_rgb(cr, 0.3, 0.8, 0.4);
+
+        cairo_rectangle(cr, 8.0f, y, std::min(peaks[i], 1.0f)*(w-16.0f), h*0.125f - 4.0f);
+        cairo_fill(cr);
+    }
+}
+
+
+DistrhoUIOpal::DistrhoUIOpal():
+    UI(360, 200),
+    display(this, 16, 16, 328, 168)
 {
 }
 
@@ -29,13 +76,70 @@ DistrhoUIOpal::~DistrhoUIOpal()
 }
 
 
+// the snapshot as output parameters, with the peaks held until displayed
 void DistrhoUIOpal::parameterChanged(uint32_t index, float value)
 {
+    switch (index) {
+    case DistrhoPluginOpal::PARAM_NUMVOICES:
+        telemetry.numvoices=std::min((int) value, (int) TelemetryFrame::NUM_VOICES);
+        break;
+    case DistrhoPluginOpal::PARAM_INPUT_PEAK:
+        telemetry.input_peak=fresh ? std::max(value, telemetry.input_peak) : value;
+        fresh=true;
+        break;
+    case DistrhoPluginOpal::PARAM_OUTPUT_PEAK:
+        telemetry.output_peak=fresh ? std::max(value, telemetry.output_peak) : value;
+        fresh=true;
+        break;
+    default:
+        if (index<DistrhoPluginOpal::PARAM_POSITION || index>=DistrhoPluginOpal::NUM_PARAMETERS)
+            return;
+
+        telemetry.position[index - DistrhoPluginOpal::PARAM_POSITION]=value;
+        break;
+    }
+
+    display.set_telemetry(telemetry);
+}
+
+
+void DistrhoUIOpal::onCairoDisplay(const CairoGraphicsContext& ctx)
+{
+    cairo_t* cr=ctx.handle;
+
+    cairo_set_source_rgb(cr, 0.12, 0.12, 0.13);
+    cairo_paint(cr);
+
+    fresh=false;
 }
 
 
-void DistrhoUIOpal::onDisplay()
+// called at about the frame rate, drains all snapshots the plugin has
+// published since, so that the ring never fills up while the UI is open
+void DistrhoUIOpal::uiIdle()
 {
+#if DISTRHO_PLUGIN_WANT_DIRECT_ACCESS
+    DistrhoPluginOpal* plugin=static_cast<DistrhoPluginOpal*>(getPluginInstancePointer());
+    if (!plugin)
+        return;
+
+    StudioGemsDSP::Telemetry& ring=plugin->get_telemetry();
+    TelemetryFrame frame;
+
+    bool any=false;
+    while (ring.pop(frame)) {
+        if (fresh) {
+            frame.input_peak=std::max(frame.input_peak, telemetry.input_peak);
+            frame.output_peak=std::max(frame.output_peak, telemetry.output_peak);
+        }
+
+        telemetry=frame;
+        fresh=any=true;
+    }
+
+    if (any)
+        display.set_telemetry(telemetry);
+#endif
 }
 
 
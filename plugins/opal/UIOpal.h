@@ -19,11 +19,33 @@
 #define DISTRHO_UI_OPAL_H_INCLUDED
 
 #include "DistrhoUI.hpp"
+#include "graphdisplay.h"
+#include "OpalTelemetry.h"
 
 START_NAMESPACE_DISTRHO
 
 // -----------------------------------------------------------------------
 
+// where the voices are within the depth, one line each, and the peaks of
+// input and output as bars along the bottom
+class ModulationDisplay : public StudioGemsUI::GraphDisplay {
+public:
+    ModulationDisplay(Widget* parent, uint x0, uint y0, uint width, uint height);
+
+    void set_telemetry(const StudioGemsDSP::TelemetryFrame& frame)
+    {
+        telemetry=frame;
+        repaint();
+    }
+
+protected:
+    void draw_graph(cairo_t*) override;
+
+private:
+    StudioGemsDSP::TelemetryFrame   telemetry {};
+};
+
+
 class DistrhoUIOpal : public UI {
 public:
     DistrhoUIOpal();
@@ -38,9 +60,19 @@ protected:
     // -------------------------------------------------------------------
     // Widget Callbacks
 
-    void onDisplay() override;
+    void onCairoDisplay(const CairoGraphicsContext&) override;
+
+    // -------------------------------------------------------------------
+    // UI Callbacks
+
+    void uiIdle() override;
 
 private:
+    // the latest snapshot, with the peaks held since the last display
+    StudioGemsDSP::TelemetryFrame   telemetry {};
+    bool    fresh=false;
+
+    ModulationDisplay   display;
 
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DistrhoUIOpal)
 };